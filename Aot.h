@@ -0,0 +1,26 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Chip8.h"
+
+// Interface of a ROM translated ahead of time by chip8aot (AotCompiler.c).
+//
+// chip8aot follows control flow from 0x200 and writes a C file with one case per basic
+// block. Linked with libchip8.a it runs that ROM as native code. Anything it couldn't
+// see statically (Bnnn targets, code that has been overwritten since load) is run by
+// the interpreter instead.
+
+// The ROM the file was generated from
+extern const uint8_t aotRom[];
+extern const size_t aotRomSize;
+// The quirk profile it was translated for. Whatever runs it must use the same (setQuirks).
+extern const QuirkProfile aotQuirks;
+
+// Same contract as runChip8. A block only runs natively if it fits in the remaining
+// budget, so timers tick at the same instruction as the interpreter.
+int aotRun(Chip8 *chip8, int count);
+
+#endif // AOT_H
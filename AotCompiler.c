@@ -0,0 +1,264 @@
+// chip8aot - translates a CHIP-8 ROM into a C file implementing Aot.h
+//
+// Usage: chip8aot [--quirks profile] rom.ch8 out.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Chip8.h"
+#include "Decoder.h"
+#include "Opcodes.h"
+
+#define ENTRY_POINT 0x200
+#define MAX_BLOCK_LENGTH 64
+
+static uint8_t memory[MEMORY_SIZE];
+// profile the ROM is decoded for. Written to the output so the runner matches it
+static QuirkProfile quirks = QUIRKS_DEFAULT;
+// 1 for every address some control flow reaches a block at
+static uint8_t isBlockStart[MEMORY_SIZE];
+static uint16_t worklist[MEMORY_SIZE];
+static int worklistSize = 0;
+// one past the last byte any block covers
+static int codeEnd = ENTRY_POINT;
+
+static void addBlock(int address) {
+    if (address < ENTRY_POINT || address + 1 >= MEMORY_SIZE || isBlockStart[address]) {
+        return;
+    }
+    isBlockStart[address] = 1;
+    worklist[worklistSize++] = address;
+}
+
+static Instruction decodeAt(int address) {
+    Instruction ins;
+    decodeInstruction(&ins, memory[address] << 8 | memory[address + 1], quirks);
+    return ins;
+}
+
+static int isSkip(OpcodeHandler handler) {
+    return isHandlerFor(handler, opcode_3xkk) || isHandlerFor(handler, opcode_4xkk)
+        || isHandlerFor(handler, opcode_5xy0) || isHandlerFor(handler, opcode_9xy0)
+        || isHandlerFor(handler, opcode_Ex9E) || isHandlerFor(handler, opcode_ExA1);
+}
+
+// Handlers that end a block, same set as the recompiler
+static int endsBlock(OpcodeHandler handler) {
+    return handler == opcode_1nnn || handler == opcode_2nnn || handler == opcode_00EE
+        || isHandlerFor(handler, opcode_Bnnn) || isSkip(handler) || handler == opcode_Fx0A
+        || handler == opcode_Fx33 || isHandlerFor(handler, opcode_Fx55) || handler == opcode_unknown
+        || handler == opcode_00FD || handler == opcode_5xy2 || handler == opcode_F000;
+}
+
+// Walks one block, queueing its successors. Returns the number of instructions.
+static int scanBlock(int start) {
+    int address = start;
+    int length = 0;
+    while (length < MAX_BLOCK_LENGTH && address + 1 < MEMORY_SIZE) {
+        Instruction ins = decodeAt(address);
+        length++;
+        if (address + 2 > codeEnd) {
+            codeEnd = address + 2;
+        }
+        if (!endsBlock(ins.handler)) {
+            address += 2;
+            continue;
+        }
+
+        if (ins.handler == opcode_1nnn) {
+            addBlock(ins.nnn);
+        } else if (ins.handler == opcode_2nnn) {
+            addBlock(ins.nnn);
+            // 00EE returns to the instruction after the call
+            addBlock(address + 2);
+        } else if (isSkip(ins.handler)) {
+            addBlock(address + 2);
+            addBlock(address + 4);
+            // XO-CHIP skips step over all four bytes of a following F000
+            if (ins.handler != opcode_3xkk && ins.handler != opcode_4xkk && ins.handler != opcode_5xy0
+                    && ins.handler != opcode_9xy0 && ins.handler != opcode_Ex9E && ins.handler != opcode_ExA1) {
+                addBlock(address + 6);
+            }
+        } else if (ins.handler == opcode_Fx0A || ins.handler == opcode_Fx33
+                   || isHandlerFor(ins.handler, opcode_Fx55) || ins.handler == opcode_5xy2) {
+            addBlock(address + 2);
+        } else if (ins.handler == opcode_F000) {
+            addBlock(address + 4);
+        }
+        // 00EE targets are the call sites above. Bnnn and unknown opcodes are left to the interpreter,
+        // and 00FD stays where it is.
+        return length;
+    }
+    addBlock(address);
+    return length;
+}
+
+static void emitInstruction(FILE *out, const Instruction *ins, int address) {
+    OpcodeHandler h = ins->handler;
+    if (h == opcode_1nnn) {
+        fprintf(out, "        chip8->pc = 0x%03X;\n", ins->nnn);
+    } else if (h == opcode_3xkk) {
+        fprintf(out, "        chip8->pc = chip8->V[%d] == 0x%02X ? 0x%03X : 0x%03X;\n", ins->x, ins->kk, address + 4, address + 2);
+    } else if (h == opcode_4xkk) {
+        fprintf(out, "        chip8->pc = chip8->V[%d] != 0x%02X ? 0x%03X : 0x%03X;\n", ins->x, ins->kk, address + 4, address + 2);
+    } else if (h == opcode_5xy0) {
+        fprintf(out, "        chip8->pc = chip8->V[%d] == chip8->V[%d] ? 0x%03X : 0x%03X;\n", ins->x, ins->y, address + 4, address + 2);
+    } else if (h == opcode_9xy0) {
+        fprintf(out, "        chip8->pc = chip8->V[%d] != chip8->V[%d] ? 0x%03X : 0x%03X;\n", ins->x, ins->y, address + 4, address + 2);
+    } else if (h == opcode_6xnn) {
+        fprintf(out, "        chip8->V[%d] = 0x%02X;\n", ins->x, ins->kk);
+    } else if (h == opcode_7xkk) {
+        fprintf(out, "        chip8->V[%d] += 0x%02X;\n", ins->x, ins->kk);
+    } else if (h == opcode_8xy0) {
+        fprintf(out, "        chip8->V[%d] = chip8->V[%d];\n", ins->x, ins->y);
+    } else if (h == opcode_8xy1) {
+        fprintf(out, "        chip8->V[%d] |= chip8->V[%d];\n", ins->x, ins->y);
+    } else if (h == opcode_8xy2) {
+        fprintf(out, "        chip8->V[%d] &= chip8->V[%d];\n", ins->x, ins->y);
+    } else if (h == opcode_8xy3) {
+        fprintf(out, "        chip8->V[%d] ^= chip8->V[%d];\n", ins->x, ins->y);
+    } else if (h == opcode_Annn) {
+        fprintf(out, "        chip8->I = 0x%03X;\n", ins->nnn);
+    } else if (h == opcode_Fx07) {
+        fprintf(out, "        chip8->V[%d] = chip8->delay_timer;\n", ins->x);
+    } else if (h == opcode_Fx15) {
+        fprintf(out, "        chip8->delay_timer = chip8->V[%d];\n", ins->x);
+    } else if (h == opcode_Fx18) {
+        fprintf(out, "        chip8->sound_timer = chip8->V[%d];\n", ins->x);
+    } else if (h == opcode_Fx1E) {
+        fprintf(out, "        chip8->I += chip8->V[%d];\n", ins->x);
+    } else {
+        // everything else calls the interpreter's handler with pc set to this instruction
+        fprintf(out, "        {\n");
+        fprintf(out, "            static const Instruction ins = {%s, 0x%04X, 0x%03X, %d, %d, %d, 0x%02X};\n",
+                handlerName(h), ins->opcode, ins->nnn, ins->x, ins->y, ins->n, ins->kk);
+        fprintf(out, "            chip8->pc = 0x%03X;\n", address);
+        fprintf(out, "            %s(chip8, &ins);\n", handlerName(h));
+        fprintf(out, "        }\n");
+    }
+}
+
+static void emitBlock(FILE *out, int start) {
+    // first pass for the length and byte range
+    int address = start;
+    int length = 0;
+    int ended = 0;
+    while (!ended && length < MAX_BLOCK_LENGTH && address + 1 < MEMORY_SIZE) {
+        ended = endsBlock(decodeAt(address).handler);
+        address += 2;
+        length++;
+    }
+    int end = address;
+
+    uint64_t pages = 0;
+    for (int page = start >> MEMORY_PAGE_SHIFT; page <= (end - 1) >> MEMORY_PAGE_SHIFT; ++page) {
+        pages |= (uint64_t)1 << page;
+    }
+
+    fprintf(out, "    case 0x%03X:\n", start);
+    fprintf(out, "        if (count - executed < %d || modified(chip8, 0x%016llXull, 0x%03X, %d)) {\n",
+            length, (unsigned long long)pages, start, end - start);
+    fprintf(out, "            break;\n");
+    fprintf(out, "        }\n");
+
+    address = start;
+    uint16_t lastOpcode = 0;
+    for (int i = 0; i < length; ++i) {
+        Instruction ins = decodeAt(address);
+        emitInstruction(out, &ins, address);
+        lastOpcode = ins.opcode;
+        address += 2;
+    }
+    if (!ended) {
+        fprintf(out, "        chip8->pc = 0x%03X;\n", address);
+    }
+    fprintf(out, "        chip8->opcode = 0x%04X;\n", lastOpcode);
+    fprintf(out, "        executed += %d;\n", length);
+    fprintf(out, "        continue;\n");
+}
+
+int main(int argc, char **argv) {
+    int arg = 1;
+    if (argc > 2 && strcmp(argv[1], "--quirks") == 0) {
+        int profile = parseQuirks(argv[2]);
+        if (profile < 0) {
+            fprintf(stderr, "Unknown quirk profile %s\n", argv[2]);
+            return 1;
+        }
+        quirks = profile;
+        arg = 3;
+    }
+    if (argc - arg < 2) {
+        fprintf(stderr, "Usage: %s [--quirks default|vip|chip48|schip|xochip] rom.ch8 out.c\n", argv[0]);
+        return 1;
+    }
+    const char *romPath = argv[arg];
+    const char *outPath = argv[arg + 1];
+
+    FILE *rom = fopen(romPath, "rb");
+    if (rom == NULL) {
+        fprintf(stderr, "Failed to open ROM %s\n", romPath);
+        return 1;
+    }
+    size_t romSize = fread(memory + ENTRY_POINT, 1, MEMORY_SIZE - ENTRY_POINT, rom);
+    fclose(rom);
+
+    // recover the control flow graph from the entry point
+    addBlock(ENTRY_POINT);
+    int blocks = 0;
+    int instructions = 0;
+    while (worklistSize > 0) {
+        instructions += scanBlock(worklist[--worklistSize]);
+        blocks++;
+    }
+
+    FILE *out = fopen(outPath, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Failed to open %s for writing\n", outPath);
+        return 1;
+    }
+
+    fprintf(out, "// Generated by chip8aot from %s. Do not edit.\n\n", romPath);
+    fprintf(out, "#include <string.h>\n\n#include \"Aot.h\"\n#include \"Opcodes.h\"\n\n");
+
+    fprintf(out, "const size_t aotRomSize = %zu;\n", romSize);
+    fprintf(out, "const QuirkProfile aotQuirks = %d;\n", quirks);
+    // the image also covers any blocks that run past the end of the file, so modified() can compare them
+    size_t imageSize = romSize;
+    if ((size_t)(codeEnd - ENTRY_POINT) > imageSize) {
+        imageSize = codeEnd - ENTRY_POINT;
+    }
+    fprintf(out, "const uint8_t aotRom[] = {");
+    for (size_t i = 0; i < imageSize; ++i) {
+        fprintf(out, "%s0x%02X,", i % 16 == 0 ? "\n    " : " ", memory[ENTRY_POINT + i]);
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "// The block's bytes no longer match the ROM\n");
+    fprintf(out, "static inline int modified(const Chip8 *chip8, uint64_t pages, int start, int length) {\n");
+    fprintf(out, "    return (chip8->writtenPages & pages) != 0\n");
+    fprintf(out, "        && memcmp(chip8->memory + start, aotRom + (start - 0x200), length) != 0;\n");
+    fprintf(out, "}\n\n");
+
+    fprintf(out, "int aotRun(Chip8 *chip8, int count) {\n");
+    fprintf(out, "    int executed = 0;\n");
+    fprintf(out, "    while (executed < count && !chip8->waitingForKey) {\n");
+    fprintf(out, "    switch (chip8->pc) {\n");
+    for (int address = ENTRY_POINT; address < MEMORY_SIZE; ++address) {
+        if (isBlockStart[address]) {
+            emitBlock(out, address);
+        }
+    }
+    fprintf(out, "    }\n");
+    fprintf(out, "    // not translated, modified, or too long for the remaining budget\n");
+    fprintf(out, "    stepChip8(chip8);\n");
+    fprintf(out, "    executed++;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    return executed;\n");
+    fprintf(out, "}\n");
+    fclose(out);
+
+    fprintf(stderr, "%s: %d blocks, %d instructions\n", outPath, blocks, instructions);
+    return 0;
+}
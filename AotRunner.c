@@ -0,0 +1,101 @@
+// Runs a ROM translated by chip8aot and checks it against the interpreter.
+//
+// Usage: RAChip8-aot [frames]
+// Both run the same frames with the same RNG seed and key state and every field of the
+// machine is compared after each frame. Then both are timed in a turbo-style run, counting
+// only the instructions that ran: idle loop passes the interpreter skips (see runChip8) are
+// reported on their own.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Aot.h"
+#include "Chip8.h"
+
+#define INSTRUCTIONS_PER_FRAME 9
+#define BENCH_INSTRUCTIONS_PER_FRAME 1000
+
+static int sameState(const Chip8 *a, const Chip8 *b) {
+    return memcmp(a->memory, b->memory, MEMORY_SIZE) == 0
+        && memcmp(a->V, b->V, GENERAL_REGISTER_COUNT) == 0
+        && a->I == b->I && a->pc == b->pc && a->sp == b->sp
+        && memcmp(a->stack, b->stack, sizeof(a->stack)) == 0
+        && a->delay_timer == b->delay_timer && a->sound_timer == b->sound_timer
+        && a->waitingForKey == b->waitingForKey && a->opcode == b->opcode
+        && memcmp(a->display.planes, b->display.planes, sizeof(a->display.planes)) == 0
+        && a->display.hires == b->display.hires && a->display.planeMask == b->display.planeMask;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// skipped gets the idle loop passes counted rather than run
+static double instructionsPerSecond(Chip8 *chip8, int translated, int frames, uint64_t *skipped) {
+    double start = now();
+    uint64_t idleAtStart = chip8->idleInstructions;
+    long executed = 0;
+    for (int frame = 0; frame < frames; ++frame) {
+        if (translated) {
+            executed += aotRun(chip8, BENCH_INSTRUCTIONS_PER_FRAME);
+        } else {
+            executed += runChip8(chip8, BENCH_INSTRUCTIONS_PER_FRAME);
+        }
+        updateTimers(chip8);
+    }
+    double seconds = now() - start;
+    *skipped = chip8->idleInstructions - idleAtStart;
+    return (executed - *skipped) / seconds;
+}
+
+int main(int argc, char **argv) {
+    int frames = argc > 1 ? atoi(argv[1]) : 3600;
+
+    static Chip8 interpreted;
+    static Chip8 translated;
+    initializeChip8(&interpreted);
+    initializeChip8(&translated);
+    setQuirks(&interpreted, aotQuirks);
+    setQuirks(&translated, aotQuirks);
+    loadRomData(&interpreted, aotRom, aotRomSize);
+    loadRomData(&translated, aotRom, aotRomSize);
+
+    int compared = 0;
+    for (int frame = 0; frame < frames; ++frame) {
+        // both start from the same RNG seed, so Cxkk produces the same numbers
+        runChip8(&interpreted, INSTRUCTIONS_PER_FRAME);
+        aotRun(&translated, INSTRUCTIONS_PER_FRAME);
+        updateTimers(&interpreted);
+        updateTimers(&translated);
+
+        if (!sameState(&interpreted, &translated)) {
+            fprintf(stderr, "State differs from the interpreter after frame %d (pc %03X vs %03X)\n",
+                    frame, interpreted.pc, translated.pc);
+            return 1;
+        }
+        compared++;
+        if (interpreted.waitingForKey) {
+            // nobody is pressing keys. stop comparing
+            break;
+        }
+    }
+    printf("Matched the interpreter for %d frames\n", compared);
+
+    initializeChip8(&interpreted);
+    initializeChip8(&translated);
+    setQuirks(&interpreted, aotQuirks);
+    setQuirks(&translated, aotQuirks);
+    loadRomData(&interpreted, aotRom, aotRomSize);
+    loadRomData(&translated, aotRom, aotRomSize);
+    uint64_t skipped;
+    double rate = instructionsPerSecond(&interpreted, 0, frames, &skipped);
+    printf("Interpreter: %.1f M instructions/s (%llu more skipped in idle loops)\n", rate / 1e6,
+           (unsigned long long)skipped);
+    rate = instructionsPerSecond(&translated, 1, frames, &skipped);
+    printf("Translated:  %.1f M instructions/s\n", rate / 1e6);
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <math.h>
+
+#include "Audio.h"
+
+#define SAMPLE_RATE 44100
+// samples per callback. About 6ms at 44.1khz
+#define BUFFER_SAMPLES 256
+// the same pitch as the old fixed 128 sample period at 14.1khz
+#define BEEP_FREQUENCY 110.0
+#define BEEP_AMPLITUDE 2000
+// time to fade the beep fully in or out
+#define RAMP_SECONDS 0.002
+// XO-CHIP patterns: 128 one-bit samples, played at 4000hz at the default pitch of 64
+#define PATTERN_SAMPLES 128
+#define PATTERN_BASE_RATE 4000.0
+
+// PolyBLEP correction for a unit step at phase 0. Subtracting it from a naive square
+// wave at each edge rounds the edge off over one sample either side, which removes
+// most of the aliasing a hard edge causes at this sample rate.
+static double polyBlep(double phase, double step) {
+    if (phase < step) {
+        double t = phase / step;
+        return t + t - t * t - 1.0;
+    } else if (phase > 1.0 - step) {
+        double t = (phase - 1.0) / step;
+        return t * t + t + t + 1.0;
+    }
+    return 0.0;
+}
+
+static void audioCallback(void *userdata, Uint8 *stream, int length) {
+    Audio *audio = (Audio *)userdata;
+    Sint16 *buffer = (Sint16 *)stream;
+    int sampleCount = length / (int)sizeof(Sint16);
+
+    float target = atomic_load_explicit(&audio->gate, memory_order_relaxed) ? 1.0f : 0.0f;
+    if (target == 0.0f && audio->level == 0.0f) {
+        SDL_memset(stream, 0, length);
+        return;
+    }
+
+    double phase = audio->phase;
+    double step = audio->phaseStep;
+    float level = audio->level;
+    int patternOn = atomic_load_explicit(&audio->patternOn, memory_order_relaxed);
+    uint64_t pattern[2];
+    double position = audio->patternPosition;
+    double positionStep = 0.0;
+    if (patternOn) {
+        pattern[0] = atomic_load_explicit(&audio->pattern[0], memory_order_relaxed);
+        pattern[1] = atomic_load_explicit(&audio->pattern[1], memory_order_relaxed);
+        int pitch = atomic_load_explicit(&audio->pitch, memory_order_relaxed);
+        positionStep = PATTERN_BASE_RATE * pow(2.0, (pitch - 64) / 48.0) / audio->sampleRate;
+    }
+    for (int i = 0; i < sampleCount; ++i) {
+        if (level < target) {
+            level = SDL_min(level + audio->rampStep, target);
+        } else if (level > target) {
+            level = SDL_max(level - audio->rampStep, target);
+        }
+
+        if (patternOn) {
+            int sample = (int)position;
+            int bit = pattern[sample >> 6] >> (63 - (sample & 63)) & 1;
+            buffer[i] = (Sint16)(BEEP_AMPLITUDE * level * (bit ? 1.0f : -1.0f));
+            position += positionStep;
+            if (position >= PATTERN_SAMPLES) {
+                position -= PATTERN_SAMPLES;
+            }
+            continue;
+        }
+
+        double square = phase < 0.5 ? 1.0 : -1.0;
+        double falling = phase + 0.5;
+        if (falling >= 1.0) {
+            falling -= 1.0;
+        }
+        square += polyBlep(phase, step) - polyBlep(falling, step);
+        buffer[i] = (Sint16)(BEEP_AMPLITUDE * level * square);
+
+        phase += step;
+        if (phase >= 1.0) {
+            phase -= 1.0;
+        }
+    }
+    audio->phase = phase;
+    audio->level = level;
+    audio->patternPosition = position;
+}
+
+int initAudio(Audio *audio) {
+    SDL_memset(audio, 0, sizeof(Audio));
+    atomic_init(&audio->gate, 0);
+    atomic_init(&audio->pattern[0], 0);
+    atomic_init(&audio->pattern[1], 0);
+    atomic_init(&audio->pitch, 64);
+    atomic_init(&audio->patternOn, 0);
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+        return -1;
+    }
+
+    SDL_AudioSpec want = {0};
+    want.freq = SAMPLE_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1; // mono
+    want.samples = BUFFER_SAMPLES;
+    want.callback = audioCallback;
+    want.userdata = audio;
+    SDL_AudioSpec have;
+    // the callback only writes mono S16, but copes with whatever rate the device wants
+    audio->device = SDL_OpenAudioDevice(NULL, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (audio->device == 0) {
+        return -1;
+    }
+    audio->sampleRate = have.freq;
+    audio->phaseStep = BEEP_FREQUENCY / have.freq;
+    audio->rampStep = (float)(1.0 / (RAMP_SECONDS * have.freq));
+
+    // runs from now on. Silence costs one memset per buffer
+    SDL_PauseAudioDevice(audio->device, 0);
+    return 0;
+}
+
+void setAudioPattern(Audio *audio, const uint8_t *pattern, uint8_t pitch) {
+    if (pattern == NULL) {
+        atomic_store_explicit(&audio->patternOn, 0, memory_order_relaxed);
+        return;
+    }
+    uint64_t any = 0;
+    for (int half = 0; half < 2; ++half) {
+        uint64_t bits = 0;
+        for (int i = 0; i < 8; ++i) {
+            bits = bits << 8 | pattern[half * 8 + i];
+        }
+        any |= bits;
+        atomic_store_explicit(&audio->pattern[half], bits, memory_order_relaxed);
+    }
+    atomic_store_explicit(&audio->pitch, pitch, memory_order_relaxed);
+    atomic_store_explicit(&audio->patternOn, any != 0, memory_order_relaxed);
+}
+
+void destroyAudio(Audio *audio) {
+    if (audio->device != 0) {
+        SDL_CloseAudioDevice(audio->device);
+        audio->device = 0;
+    }
+}
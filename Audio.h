@@ -0,0 +1,58 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+// The beeper. The device plays continuously from the moment it is opened; the emulator
+// only publishes whether the sound timer is running, through an atomic the audio callback
+// reads once per buffer. Nothing in the emulation loop touches the audio device.
+//
+// The callback makes a band-limited (PolyBLEP) square wave whose phase carries on from
+// buffer to buffer, and fades it in and out over a couple of milliseconds when the gate
+// changes, so beeps start and stop without clicks.
+// XO-CHIP ROMs can load a 128-sample 1-bit pattern (F002) and a playback rate (Fx3A) to
+// play instead; those are published the same way and the callback plays them in place of
+// the square wave.
+typedef struct {
+    // 0 if no device could be opened. Everything still works, silently
+    SDL_AudioDeviceID device;
+    // written by the emulator, read by the callback
+    atomic_int gate;
+    // the XO-CHIP pattern as two halves, first sample in the top bit of pattern[0], and its
+    // pitch register. patternOn is 0 for the square wave. The halves are stored separately,
+    // so a buffer can at worst mix an old half with a new one
+    _Atomic uint64_t pattern[2];
+    atomic_int pitch;
+    atomic_int patternOn;
+
+    // owned by the callback
+    int sampleRate;
+    // position in the current cycle, 0 to 1, and how far it moves per sample
+    double phase;
+    double phaseStep;
+    // current loudness, 0 to 1, and how far it moves per sample towards the gate
+    float level;
+    float rampStep;
+    // position in the pattern, 0 to 128 samples
+    double patternPosition;
+} Audio;
+
+// Opens the default device and starts it. Returns -1 if there is no audio.
+int initAudio(Audio *audio);
+
+// Call whenever the sound timer may have changed. A relaxed atomic store; no locks or syscalls.
+static inline void setAudioGate(Audio *audio, int on) {
+    atomic_store_explicit(&audio->gate, on, memory_order_relaxed);
+}
+
+// Plays pattern (16 bytes, as loaded by F002) at pitch (Fx3A) while the gate is open, instead
+// of the square wave. NULL, or a pattern that's all zeros (no F002 yet), goes back to the square
+// wave. Cheap enough to call whenever the gate is set.
+void setAudioPattern(Audio *audio, const uint8_t *pattern, uint8_t pitch);
+
+void destroyAudio(Audio *audio);
+
+#endif // AUDIO_H
@@ -0,0 +1,365 @@
+// chip8bench - headless interpreter benchmark
+//
+// Usage: chip8bench [--instructions N] [--ipf N] [--json results.json] [rom.ch8 ...]
+//
+// Runs the TestROMs (or the ROMs given) and a set of synthetic ROMs, each of which loops over
+// one class of opcodes, for a fixed number of instructions on the interpreter and, where the
+// host has one, the recompiler. Reports instructions per second, ns per instruction for each
+// opcode class, and the cost of expanding a frame to pixels the way the renderer does.
+// Rates only count the instructions that really ran. The passes of idle loops the interpreter
+// counts rather than runs (see runChip8) are reported on their own as skipped.
+// A summary goes to stderr and the results to stdout (or --json) as JSON, so two builds
+// can be compared with any JSON diff.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Chip8.h"
+#include "Jit.h"
+#include "Profile.h"
+
+#define MAX_ROMS 32
+#define RENDER_ITERATIONS 20000
+
+typedef struct {
+    const char *name;
+    // the synthetic ROM image. size is 0 for ROMs loaded from disk by name
+    uint8_t data[MEMORY_SIZE - 0x200];
+    size_t size;
+} BenchRom;
+
+typedef struct {
+    const char *rom;
+    const char *backend;
+    // instructions run, not counting skipped ones
+    uint64_t instructions;
+    uint64_t skipped;
+    double seconds;
+    double renderNanoseconds;
+} BenchResult;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void emit(BenchRom *rom, uint16_t opcode) {
+    rom->data[rom->size++] = opcode >> 8;
+    rom->data[rom->size++] = opcode & 0xFF;
+}
+
+// Each synthetic ROM sets up registers, then loops over a body of one opcode class.
+// Loops jump back to LOOP_START.
+#define LOOP_START 0x210
+// scratch memory for the load/store class, well clear of the code
+#define SCRATCH 0xE00
+
+static void beginSynthetic(BenchRom *rom, const char *name) {
+    rom->name = name;
+    rom->size = 0;
+    // V0..V7 = 1..8 so the ALU and skips have something to chew on
+    for (int x = 0; x < 8; ++x) {
+        emit(rom, 0x6000 | x << 8 | (x + 1));
+    }
+    while (rom->size < LOOP_START - 0x200) {
+        emit(rom, 0x7000 | 0xE << 8 | 1);
+    }
+}
+
+static void endSynthetic(BenchRom *rom) {
+    emit(rom, 0x1000 | LOOP_START);
+}
+
+static int buildSyntheticRoms(BenchRom *roms) {
+    BenchRom *rom = roms;
+
+    beginSynthetic(rom, "synthetic:alu");
+    for (int i = 0; i < 8; ++i) {
+        int x = i % 8;
+        int y = (i + 3) % 8;
+        emit(rom, 0x7000 | x << 8 | 0x13);
+        emit(rom, 0x8000 | x << 8 | y << 4 | 0x1);
+        emit(rom, 0x8000 | x << 8 | y << 4 | 0x4);
+        emit(rom, 0x8000 | x << 8 | y << 4 | 0x5);
+        emit(rom, 0x8000 | y << 8 | x << 4 | 0x3);
+        emit(rom, 0x8000 | x << 8 | 0x6);
+        emit(rom, 0x8000 | y << 8 | 0xE);
+        emit(rom, 0x6000 | y << 8 | 0x5A);
+    }
+    endSynthetic(rom++);
+
+    beginSynthetic(rom, "synthetic:skip");
+    for (int i = 0; i < 16; ++i) {
+        int x = i % 8;
+        // the skipped instruction is harmless either way
+        emit(rom, (i & 1 ? 0x3000 : 0x4000) | x << 8 | (x + 1));
+        emit(rom, 0x7000 | 0xD << 8 | 1);
+        emit(rom, (i & 1 ? 0x5000 : 0x9000) | x << 8 | ((x + 1) % 8) << 4);
+        emit(rom, 0x7000 | 0xD << 8 | 1);
+    }
+    endSynthetic(rom++);
+
+    // a chain of calls into a subroutine that returns straight away
+    beginSynthetic(rom, "synthetic:call");
+    uint16_t subroutine = LOOP_START + 2 * 33;
+    for (int i = 0; i < 32; ++i) {
+        emit(rom, 0x2000 | subroutine);
+    }
+    endSynthetic(rom);
+    emit(rom, 0x00EE);
+    rom++;
+
+    beginSynthetic(rom, "synthetic:memory");
+    for (int i = 0; i < 8; ++i) {
+        emit(rom, 0xA000 | SCRATCH);
+        emit(rom, 0xF01E | (i % 8) << 8);
+        emit(rom, 0xF033 | (i % 8) << 8);
+        emit(rom, 0xF055 | 7 << 8);
+        emit(rom, 0xF065 | 7 << 8);
+        emit(rom, 0xF029 | (i % 8) << 8);
+    }
+    endSynthetic(rom++);
+
+    beginSynthetic(rom, "synthetic:draw");
+    emit(rom, 0x00E0);
+    for (int i = 0; i < 16; ++i) {
+        emit(rom, 0xF029 | (i % 8) << 8);
+        emit(rom, 0xD005 | (i % 8) << 8 | ((i + 2) % 8) << 4);
+        emit(rom, 0x7000 | (i % 8) << 8 | 7);
+    }
+    endSynthetic(rom++);
+
+    beginSynthetic(rom, "synthetic:timers-keys");
+    for (int i = 0; i < 8; ++i) {
+        int x = i % 8;
+        emit(rom, 0xF015 | x << 8);
+        emit(rom, 0xF007 | x << 8);
+        emit(rom, 0xF018 | x << 8);
+        // no keys are held, so SKNP always skips and SKP never does
+        emit(rom, 0xE0A1 | x << 8);
+        emit(rom, 0x7000 | 0xD << 8 | 1);
+        emit(rom, 0xE09E | x << 8);
+        emit(rom, 0x7000 | 0xD << 8 | 1);
+    }
+    endSynthetic(rom++);
+
+    beginSynthetic(rom, "synthetic:rng");
+    for (int i = 0; i < 32; ++i) {
+        emit(rom, 0xC0FF | (i % 8) << 8);
+    }
+    endSynthetic(rom++);
+
+    return rom - roms;
+}
+
+static int loadBenchRom(Chip8 *chip8, const BenchRom *rom) {
+    if (rom->size > 0) {
+        return loadRomData(chip8, rom->data, rom->size);
+    }
+    return loadRom(chip8, rom->name);
+}
+
+static int runBench(const BenchRom *rom, Jit *jit, uint64_t instructions, int instructionsPerFrame,
+                    BenchResult *result) {
+    static Chip8 chip8;
+    initializeChip8(&chip8);
+    chip8.jit = jit;
+    if (loadBenchRom(&chip8, rom) != 0) {
+        fprintf(stderr, "Failed to open ROM %s\n", rom->name);
+        return -1;
+    }
+
+    // warm the caches (and let the recompiler translate the hot blocks) before timing
+    for (int frame = 0; frame < 100; ++frame) {
+        runChip8(&chip8, instructionsPerFrame);
+        updateTimers(&chip8);
+    }
+
+    uint64_t executed = 0;
+    uint64_t idleAtStart = chip8.idleInstructions;
+    double start = now();
+    while (executed < instructions) {
+        int ran = runChip8(&chip8, instructionsPerFrame);
+        updateTimers(&chip8);
+        if (ran == 0) {
+            // halted on Fx0A. Nothing more to measure
+            break;
+        }
+        executed += ran;
+    }
+    double seconds = now() - start;
+
+    // what the renderer does with the framebuffer each frame it presents
+    static uint32_t pixels[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+    static const uint32_t benchPalette[4] = {0xFF000000, 0xFFFFFFFF, 0xFFFF6020, 0xFFFFFFFF};
+    double renderStart = now();
+    for (int i = 0; i < RENDER_ITERATIONS; ++i) {
+        displayToPixels(&chip8.display, pixels, 0, displayHeight(&chip8.display) - 1, benchPalette);
+    }
+    double renderSeconds = now() - renderStart;
+
+    result->rom = rom->name;
+    result->backend = jit != NULL ? "jit" : "interpreter";
+    result->skipped = chip8.idleInstructions - idleAtStart;
+    result->instructions = executed - result->skipped;
+    result->seconds = seconds;
+    result->renderNanoseconds = renderSeconds / RENDER_ITERATIONS * 1e9;
+    return 0;
+}
+
+static void printJsonString(FILE *out, const char *text) {
+    fputc('"', out);
+    for (; *text; ++text) {
+        if (*text == '"' || *text == '\\') {
+            fputc('\\', out);
+        }
+        fputc(*text, out);
+    }
+    fputc('"', out);
+}
+
+// Rates are undefined when no instructions ran (the ROM halted on Fx0A, or every pass was
+// a skipped idle loop), and JSON has no inf or nan, so those are written as null
+static int hasRates(const BenchResult *result) {
+    return result->instructions > 0 && result->seconds > 0;
+}
+
+static void printRate(FILE *out, const char *format, double value, int valid) {
+    if (valid) {
+        fprintf(out, format, value);
+    } else {
+        fprintf(out, "null");
+    }
+}
+
+static void writeJson(FILE *out, const BenchResult *results, int count, uint64_t instructions,
+                      int instructionsPerFrame) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"compiler\": ");
+    printJsonString(out, __VERSION__);
+    fprintf(out, ",\n  \"instructions\": %llu,\n", (unsigned long long)instructions);
+    fprintf(out, "  \"instructions_per_frame\": %d,\n", instructionsPerFrame);
+    fprintf(out, "  \"results\": [\n");
+    for (int i = 0; i < count; ++i) {
+        const BenchResult *result = &results[i];
+        fprintf(out, "    {\"rom\": ");
+        printJsonString(out, result->rom);
+        fprintf(out, ", \"backend\": \"%s\", \"instructions\": %llu, \"skipped\": %llu, \"seconds\": %.6f, ",
+                result->backend, (unsigned long long)result->instructions,
+                (unsigned long long)result->skipped, result->seconds);
+        fprintf(out, "\"instructions_per_second\": ");
+        printRate(out, "%.0f", result->instructions / result->seconds, hasRates(result));
+        fprintf(out, ", \"ns_per_instruction\": ");
+        printRate(out, "%.3f", result->seconds * 1e9 / result->instructions, hasRates(result));
+        fprintf(out, ", \"render_ns_per_frame\": %.1f}%s\n", result->renderNanoseconds, i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ],\n");
+
+    // ns per instruction of each synthetic ROM, keyed by opcode class then backend
+    const char *prefix = "synthetic:";
+    fprintf(out, "  \"opcode_classes\": {");
+    int first = 1;
+    for (int i = 0; i < count; ++i) {
+        const BenchResult *result = &results[i];
+        if (strncmp(result->rom, prefix, strlen(prefix)) != 0) {
+            continue;
+        }
+        const char *name = result->rom + strlen(prefix);
+        // results for one ROM are next to each other
+        if (i == 0 || strcmp(results[i - 1].rom, result->rom) != 0) {
+            fprintf(out, "%s\n    ", first ? "" : "},");
+            printJsonString(out, name);
+            fprintf(out, ": {");
+            first = 0;
+        } else {
+            fprintf(out, ", ");
+        }
+        fprintf(out, "\"%s\": ", result->backend);
+        printRate(out, "%.3f", result->seconds * 1e9 / result->instructions, hasRates(result));
+    }
+    fprintf(out, "%s\n  }\n}\n", first ? "" : "}");
+}
+
+int main(int argc, char **argv) {
+    uint64_t instructions = 20000000;
+    int instructionsPerFrame = 1000;
+    const char *jsonPath = NULL;
+
+    static BenchRom roms[MAX_ROMS];
+    int romCount = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--instructions") == 0 && i + 1 < argc) {
+            instructions = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--ipf") == 0 && i + 1 < argc) {
+            instructionsPerFrame = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (argv[i][0] == '-') {
+            // --help, an unknown option or one missing its value
+            fprintf(stderr, "Usage: %s [--instructions N] [--ipf N] [--json results.json] [rom.ch8 ...]\n", argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        } else if (romCount < MAX_ROMS - 8) {
+            roms[romCount++].name = argv[i];
+        }
+    }
+    if (romCount == 0) {
+        roms[romCount++].name = "TestROMs/chiptest-offstatic.ch8";
+        roms[romCount++].name = "TestROMs/chiptest-mini-offstatic.ch8";
+    }
+    romCount += buildSyntheticRoms(&roms[romCount]);
+
+#ifdef CHIP8_PROFILE
+    // profiled builds always interpret, so a recompiler pass would only repeat the interpreter's
+    Jit *jit = NULL;
+#else
+    Jit *jit = createJit();
+#endif
+    static BenchResult results[MAX_ROMS * 2];
+    int resultCount = 0;
+    for (int r = 0; r < romCount; ++r) {
+        for (int backend = 0; backend < 2; ++backend) {
+            Jit *useJit = backend == 1 ? jit : NULL;
+            if (backend == 1 && jit == NULL) {
+                continue;
+            }
+            BenchResult *result = &results[resultCount];
+            if (runBench(&roms[r], useJit, instructions, instructionsPerFrame, result) != 0) {
+                // the ROM couldn't be loaded, so there's no point trying the other backend
+                break;
+            }
+            resultCount++;
+            if (!hasRates(result)) {
+                fprintf(stderr, "%-40s %-12s no instructions ran (halted on Fx0A or only idle loops)"
+                        "  %llu skipped\n",
+                        result->rom, result->backend, (unsigned long long)result->skipped);
+                continue;
+            }
+            fprintf(stderr, "%-40s %-12s %8.1f M instructions/s %7.2f ns/instruction  render %6.0f ns/frame"
+                    "  %llu skipped\n",
+                    result->rom, result->backend, result->instructions / result->seconds / 1e6,
+                    result->seconds * 1e9 / result->instructions, result->renderNanoseconds,
+                    (unsigned long long)result->skipped);
+        }
+    }
+    destroyJit(jit);
+
+    FILE *out = stdout;
+    if (jsonPath != NULL) {
+        out = fopen(jsonPath, "w");
+        if (out == NULL) {
+            fprintf(stderr, "Failed to open %s for writing\n", jsonPath);
+            return 1;
+        }
+    }
+    writeJson(out, results, resultCount, instructions, instructionsPerFrame);
+    if (out != stdout) {
+        fclose(out);
+    }
+#ifdef CHIP8_PROFILE
+    saveProfileReport("profile.txt");
+#endif
+    return 0;
+}
@@ -1,4 +1,12 @@
+#include <stdio.h>
+#include <string.h>
+
 #include "Chip8.h"
+#include "Opcodes.h"
+#include "Decoder.h"
+#include "Jit.h"
+#include "Random.h"
+#include "Profile.h"
 
 void initializeChip8(Chip8 *chip8) {
     // 0x000 to 0x1FF reserved for interpreter itself
@@ -6,6 +14,15 @@ void initializeChip8(Chip8 *chip8) {
     chip8->opcode = 0;
     chip8->I = 0;
     chip8->sp = 0;
+    chip8->waitingForKey = 0;
+    seedChip8(chip8, CHIP8_DEFAULT_SEED);
+    chip8->keyRegister = 0;
+    chip8->frameCycles = 0;
+    chip8->frameInstructions = 0;
+    chip8->jit = NULL;
+    chip8->quirks = QUIRKS_DEFAULT;
+    chip8->writtenPages = 0;
+    chip8->idleInstructions = 0;
     
     // Clear stack, registers, and memory
     for (int i = 0; i < STACK_SIZE; ++i) {
@@ -14,6 +31,7 @@ void initializeChip8(Chip8 *chip8) {
     for (int i = 0; i < GENERAL_REGISTER_COUNT; ++i) {
         chip8->V[i] = 0;
     }
+    chip8->keys = 0;
     for (int i = 0; i < MEMORY_SIZE; ++i) {
         chip8->memory[i] = 0;
     }
@@ -46,8 +64,262 @@ void initializeChip8(Chip8 *chip8) {
     for (int i = 0; i < 80; ++i) {
         chip8->memory[i] = chip8_fontset[i];
     }
+    // 8x10 digits for Fx30
+    static const uint8_t bigFont[160] = {
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+    };
+    memcpy(chip8->memory + BIG_FONT_ADDRESS, bigFont, sizeof(bigFont));
+
+    memset(chip8->userFlags, 0, sizeof(chip8->userFlags));
+    memset(chip8->audioPattern, 0, sizeof(chip8->audioPattern));
+    // 4000 samples a second
+    chip8->pitch = 64;
 
     // Reset timers
     chip8->delay_timer = 0;
     chip8->sound_timer = 0;
+
+    initDisplay(&chip8->display);
+    // whatever the cache held, every entry has to be reset the first time
+    chip8->decodedPages = ~(uint64_t)0;
+    predecodeMemory(chip8);
+}
+
+void setQuirks(Chip8 *chip8, QuirkProfile quirks) {
+    chip8->quirks = quirks;
+    predecodeMemory(chip8);
+}
+
+int parseQuirks(const char *name) {
+    static const char *names[QUIRK_PROFILES] = {
+        [QUIRKS_DEFAULT] = "default", [QUIRKS_VIP] = "vip",
+        [QUIRKS_CHIP48] = "chip48", [QUIRKS_SCHIP] = "schip", [QUIRKS_XOCHIP] = "xochip",
+    };
+    for (int profile = 0; profile < QUIRK_PROFILES; ++profile) {
+        if (strcmp(name, names[profile]) == 0) {
+            return profile;
+        }
+    }
+    return -1;
+}
+
+void seedChip8(Chip8 *chip8, uint64_t seed) {
+    pcg32Seed(&chip8->rngState, seed);
+}
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+uint64_t hashChip8(const Chip8 *chip8) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    hash = fnv1a(hash, chip8->memory, MEMORY_SIZE);
+    hash = fnv1a(hash, chip8->V, GENERAL_REGISTER_COUNT);
+    hash = fnv1a(hash, &chip8->I, sizeof(chip8->I));
+    hash = fnv1a(hash, &chip8->pc, sizeof(chip8->pc));
+    hash = fnv1a(hash, chip8->stack, sizeof(chip8->stack));
+    hash = fnv1a(hash, &chip8->sp, sizeof(chip8->sp));
+    hash = fnv1a(hash, &chip8->delay_timer, sizeof(chip8->delay_timer));
+    hash = fnv1a(hash, &chip8->sound_timer, sizeof(chip8->sound_timer));
+    hash = fnv1a(hash, &chip8->rngState, sizeof(chip8->rngState));
+    hash = fnv1a(hash, chip8->userFlags, sizeof(chip8->userFlags));
+    hash = fnv1a(hash, chip8->display.planes, sizeof(chip8->display.planes));
+    hash = fnv1a(hash, &chip8->display.hires, sizeof(chip8->display.hires));
+    hash = fnv1a(hash, &chip8->display.planeMask, sizeof(chip8->display.planeMask));
+    return hash;
+}
+
+int loadRom(Chip8 *chip8, const char *path) {
+    FILE *rom = fopen(path, "rb");
+    if (rom == NULL) {
+        return -1;
+    }
+    fread(chip8->memory + 0x200, 1, MEMORY_SIZE - 0x200, rom);
+    fclose(rom);
+    predecodeMemory(chip8);
+    return 0;
+}
+
+int loadRomData(Chip8 *chip8, const uint8_t *data, size_t size) {
+    if (size > MEMORY_SIZE - 0x200) {
+        return -1;
+    }
+    memcpy(chip8->memory + 0x200, data, size);
+    predecodeMemory(chip8);
+    return 0;
+}
+
+int stepChip8(Chip8 *chip8) {
+    if (chip8->waitingForKey) {
+        return CHIP8_WAITING_FOR_KEY;
+    }
+
+    // The decode cache holds the handler and operands for every address,
+    // so executing is a single indirect call.
+    uint16_t pc = chip8->pc;
+    const Instruction *ins = &chip8->decoded[pc % MEMORY_SIZE];
+    chip8->opcode = ins->opcode;
+    PROFILE_START();
+    ins->handler(chip8, ins);
+    // chip8->opcode rather than ins->opcode, which is stale if the entry was invalidated
+    PROFILE_END(pc, chip8->opcode, chip8->quirks);
+    (void)pc;
+
+    if (chip8->waitingForKey) {
+        return CHIP8_WAITING_FOR_KEY;
+    }
+    if (ins->handler == opcode_unknown) {
+        return CHIP8_UNKNOWN_OPCODE;
+    }
+    return CHIP8_OK;
+}
+
+// Idle loops: a backward jump over a few instructions that only read and write registers,
+// e.g. Fx07; 3x00; 1nnn polling the delay timer. Within one runChip8 call the timers and keys
+// can't change, so once the registers are the same at two consecutive passes through the jump,
+// every further pass is the same too and can be counted instead of run.
+// That only holds if nothing but the loop ran in between, so the tracking starts over whenever
+// control goes anywhere outside target..pc (a call, a return, Bnnn, a skip past the jump).
+#define MAX_IDLE_LOOP 8
+
+typedef struct {
+    // the last backward jump seen (at pc, to target), and the state when it was reached
+    uint16_t pc;
+    uint16_t target;
+    // set if the loop only touches registers (isIdleLoop), checked when the jump is first seen.
+    // Nothing in the loop can write memory then, so it stays true while control stays inside
+    uint8_t idle;
+    int executed;
+    uint16_t I;
+    uint8_t V[GENERAL_REGISTER_COUNT];
+} IdleLoop;
+
+// The register-only opcodes whose handler depends on the quirk profile
+static int isRegisterOnlyQuirkHandler(OpcodeHandler handler) {
+    static const OpcodeHandler bases[] = {
+        opcode_8xy1, opcode_8xy2, opcode_8xy3, opcode_8xy4, opcode_8xy5,
+        opcode_8xy6, opcode_8xy7, opcode_8xyE, opcode_Fx65,
+    };
+    for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); ++i) {
+        if (isHandlerFor(handler, bases[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Returns 1 if every instruction from target up to the jump at pc only touches registers.
+// Anything that writes memory, the screen, the timers, the stack or the random state, or
+// that jumps elsewhere, rules the loop out.
+static int isIdleLoop(Chip8 *chip8, uint16_t target, uint16_t pc) {
+    if (pc - target > 2 * (MAX_IDLE_LOOP - 1)) {
+        return 0;
+    }
+    for (uint16_t address = target; address < pc; address += 2) {
+        OpcodeHandler handler = decodedInstruction(chip8, address)->handler;
+        if (handler == opcode_F000) {
+            // XO-CHIP's long I load. Its second word is the address, not an instruction
+            address += 2;
+        } else if (handler != opcode_3xkk && handler != opcode_4xkk && handler != opcode_5xy0
+                && handler != opcode_9xy0 && handler != opcode_6xnn && handler != opcode_7xkk
+                && handler != opcode_8xy0 && handler != opcode_Annn && handler != opcode_Ex9E
+                && handler != opcode_ExA1 && handler != opcode_Fx07 && handler != opcode_Fx1E
+                && handler != opcode_Fx29 && handler != opcode_Fx30 && handler != opcode_3xkk_xochip
+                && handler != opcode_4xkk_xochip && handler != opcode_5xy0_xochip
+                && handler != opcode_9xy0_xochip && handler != opcode_Ex9E_xochip
+                && handler != opcode_ExA1_xochip && handler != opcode_5xy3
+                && !isRegisterOnlyQuirkHandler(handler)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Called at a backward jump at pc with executed of count instructions done.
+// Returns how many instructions can be skipped: whole passes of the loop that would leave
+// the machine exactly as it is now.
+static int skipIdleLoop(Chip8 *chip8, IdleLoop *loop, uint16_t pc, uint16_t target,
+                        int executed, int count) {
+    if (loop->pc != pc || loop->target != target) {
+        loop->pc = pc;
+        loop->target = target;
+        loop->idle = isIdleLoop(chip8, target, pc);
+    } else if (loop->idle && loop->I == chip8->I
+            && memcmp(loop->V, chip8->V, GENERAL_REGISTER_COUNT) == 0) {
+        int length = executed - loop->executed;
+        int skipped = (count - executed) / length * length;
+        loop->executed = executed + skipped;
+        return skipped;
+    }
+    loop->executed = executed;
+    loop->I = chip8->I;
+    memcpy(loop->V, chip8->V, GENERAL_REGISTER_COUNT);
+    return 0;
+}
+
+int runChip8(Chip8 *chip8, int count) {
+#ifndef CHIP8_PROFILE
+    // the profiler counts every instruction, which compiled blocks can't do
+    if (chip8->jit != NULL) {
+        return runChip8Jit(chip8, count);
+    }
+#endif
+
+    // no address holds a jump at 0xFFFF, so nothing matches until the first backward jump
+    IdleLoop loop = {.pc = 0xFFFF};
+    int executed = 0;
+    while (executed < count) {
+        if (chip8->waitingForKey) {
+            break;
+        }
+        uint16_t pc = chip8->pc;
+        const Instruction *ins = &chip8->decoded[pc % MEMORY_SIZE];
+        if (ins->handler == opcode_1nnn && ins->nnn <= pc) {
+            int skipped = skipIdleLoop(chip8, &loop, pc, ins->nnn, executed, count);
+            chip8->idleInstructions += skipped;
+            executed += skipped;
+            if (executed == count) {
+                break;
+            }
+        } else if (pc < loop.target || pc > loop.pc) {
+            // left the loop. Whatever ran out here could have changed anything
+            loop.pc = 0xFFFF;
+        }
+        chip8->opcode = ins->opcode;
+        PROFILE_START();
+        ins->handler(chip8, ins);
+        PROFILE_END(pc, chip8->opcode, chip8->quirks);
+        (void)pc;
+        executed++;
+    }
+    return executed;
+}
+
+void updateTimers(Chip8 *chip8) {
+    if (chip8->delay_timer > 0) {
+        --chip8->delay_timer;
+    }
+    if (chip8->sound_timer > 0) {
+        --chip8->sound_timer;
+    }
 }
\ No newline at end of file
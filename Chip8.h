@@ -1,24 +1,76 @@
 #ifndef CHIP8_H
 #define CHIP8_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "Display.h"
 
-// Memory addresses are 0x000 to 0xFFF
-#define MEMORY_SIZE 4096
+// Memory addresses are 0x000 to 0xFFF, or up to 0xFFFF on XO-CHIP. Every machine gets the
+// full 64 KB so an address never needs checking against the platform's size.
+#define MEMORY_SIZE 65536
+// writtenPages and the recompiler track memory in 64 pages of 1 << MEMORY_PAGE_SHIFT bytes
+#define MEMORY_PAGE_SHIFT 10
 // 16 general 8-bit registers. V0 to VF. VF never used by programs 
 //  and is used as a flag by some instructions.
 // there is also a 16-bit register I. Stores memory addresses.
 #define GENERAL_REGISTER_COUNT 16
 #define STACK_SIZE 16
+// hex keypad 0x0 to 0xF
+#define KEYS 16
+// SUPER-CHIP's 8x10 digits (0-F on XO-CHIP) for Fx30 are loaded after the 4x5 ones
+#define BIG_FONT_ADDRESS 0x50
+// Fx75/Fx85 save and restore up to this many registers
+#define USER_FLAGS 16
 
-#define RED_VAL 0
-#define GREEN_VAL 255
-#define BLUE_VAL 255
-#define ALPHA_VAL 255
+// Seed used by initializeChip8. Frontends reseed with seedChip8.
+#define CHIP8_DEFAULT_SEED 1
 
-typedef struct {
+// Results of stepChip8
+#define CHIP8_OK 0
+// Fx0A halted the CPU. Execution resumes once pressKey is called.
+#define CHIP8_WAITING_FOR_KEY 1
+#define CHIP8_UNKNOWN_OPCODE 2
+
+// Platforms disagree on what a few opcodes do. A profile picks which platform to follow.
+// Each profile decodes those opcodes to its own specialized handlers (see QuirkHandlers in
+// Opcodes.h), so following one costs nothing per instruction.
+typedef enum {
+    // what this emulator has always done: 8xy6/8xyE ignore Vy, Fx55/Fx65 leave I alone,
+    // Bnnn adds V0 and sprites wrap around the screen edges
+    QUIRKS_DEFAULT,
+    // the original COSMAC VIP interpreter
+    QUIRKS_VIP,
+    // CHIP-48 on the HP 48
+    QUIRKS_CHIP48,
+    // SUPER-CHIP 1.1. Adds the 128x64 mode, scrolling and 16x16 sprites
+    QUIRKS_SCHIP,
+    // XO-CHIP as Octo runs it. SUPER-CHIP's additions plus 64 KB of memory, a second
+    // bitplane and the long I load
+    QUIRKS_XOCHIP,
+    QUIRK_PROFILES
+} QuirkProfile;
+
+typedef struct Chip8 Chip8;
+typedef struct Instruction Instruction;
+typedef struct Jit Jit;
+
+// Every opcode handler in Opcodes.c has this signature
+typedef void (*OpcodeHandler)(Chip8 *chip8, const Instruction *ins);
+
+// A predecoded instruction. The operands are pulled out of the opcode once
+// when it is decoded instead of on every execution.
+struct Instruction {
+    OpcodeHandler handler;
+    uint16_t opcode;
+    uint16_t nnn;
+    uint8_t x;
+    uint8_t y;
+    uint8_t n;
+    uint8_t kk;
+};
+
+struct Chip8 {
     uint8_t memory[MEMORY_SIZE];
     // registers
     uint8_t V[GENERAL_REGISTER_COUNT];
@@ -30,10 +82,85 @@ typedef struct {
     uint8_t delay_timer;
     uint8_t sound_timer;
 
+    // bit k is set while key k is held. Written by pressKey/releaseKey
+    uint16_t keys;
+    // PCG32 state for Cxkk's random numbers (see Random.h). Each instance has its own
+    // so they can run in parallel, and a run can be replayed from its seed.
+    uint64_t rngState;
+
+    // set by Fx0A. keyRegister is the x of the waiting instruction
+    uint8_t waitingForKey;
+    uint8_t keyRegister;
+    // machine cycles used so far this frame when running with VIP timing (see Timing.h),
+    // including any carried over from the last frame's final instruction
+    uint16_t frameCycles;
+    // instructions run since the last display interrupt with VIP timing. 0 means the frame
+    // hasn't started, which frameCycles can't tell once it holds an overrun
+    uint16_t frameInstructions;
+
+    // registers saved by Fx75 (the HP 48's RPL flags on SUPER-CHIP)
+    uint8_t userFlags[USER_FLAGS];
+    // XO-CHIP sound: the 128 one-bit samples loaded by F002, played at the rate set by Fx3A
+    uint8_t audioPattern[16];
+    uint8_t pitch;
+
     Display display;
+    // last opcode executed
     uint16_t opcode;
-} Chip8;
+
+    // one decoded instruction per memory address (instructions can start on odd addresses).
+    // Entries for memory that was written since it was decoded point at a handler that
+    // decodes them again on first use. See Decoder.h.
+    Instruction decoded[MEMORY_SIZE];
+    // bit n is set once anything in page n (see MEMORY_PAGE_SHIFT) has been decoded. Entries
+    // are only decoded the first time they run, so throwing the cache away (predecodeMemory)
+    // just resets the pages that were used, rather than decoding all 64K addresses.
+    uint64_t decodedPages;
+    // bit n is set once memory in page n (see MEMORY_PAGE_SHIFT) has been written by the program.
+    // Lets translated code (see Aot.h) cheaply check it is still running the original ROM.
+    uint64_t writtenPages;
+    // optional native code backend used by runChip8. NULL to interpret. See Jit.h.
+    Jit *jit;
+    // QuirkProfile the decode cache was built for. Change it with setQuirks
+    uint8_t quirks;
+    // instructions runChip8 counted rather than ran in idle loops. Like display.spritesDrawn it
+    // only feeds the instruction budget tuner (Tuner.h) and isn't part of the machine state
+    uint64_t idleInstructions;
+};
 
 void initializeChip8(Chip8 *chip8);
 
-#endif // CHIP8_H
\ No newline at end of file
+// Switches to another quirk profile and decodes memory again for it
+void setQuirks(Chip8 *chip8, QuirkProfile quirks);
+
+// Looks up a profile by name: "default", "vip", "chip48", "schip" or "xochip". Returns -1 if unknown
+int parseQuirks(const char *name);
+
+// Restarts Cxkk's random number sequence from seed
+void seedChip8(Chip8 *chip8, uint64_t seed);
+
+// FNV-1a hash of the machine state (memory, registers, stack, timers, RNG and framebuffer).
+// Two runs that hash the same ended in the same state.
+uint64_t hashChip8(const Chip8 *chip8);
+
+// Loads a ROM file into memory starting at 0x200 and resets the decode cache.
+// Returns 0 on success, -1 on failure.
+int loadRom(Chip8 *chip8, const char *path);
+
+// Loads a ROM image already in memory. Returns -1 if it doesn't fit.
+int loadRomData(Chip8 *chip8, const uint8_t *data, size_t size);
+
+// Executes the instruction at pc.
+int stepChip8(Chip8 *chip8);
+
+// Executes up to count instructions. Stops early if the CPU is waiting for a key.
+// Uses the recompiler if chip8->jit is set. The interpreter counts the passes of a loop that
+// only waits on the timers or keys rather than running them, since nothing changes until the
+// next updateTimers or key event. Those are added to chip8->idleInstructions.
+// Returns the number of instructions executed, counting the ones skipped.
+int runChip8(Chip8 *chip8, int count);
+
+// Decrements the delay and sound timers. Call at 60hz.
+void updateTimers(Chip8 *chip8);
+
+#endif // CHIP8_H
@@ -0,0 +1,165 @@
+#include <stdio.h>
+
+#include "Decoder.h"
+#include "Opcodes.h"
+#include "Jit.h"
+
+// Decodes the instruction at address from current memory into its cache entry
+static Instruction *decodeEntry(Chip8 *chip8, uint16_t address) {
+    Instruction *entry = &chip8->decoded[address];
+    decodeInstruction(entry, chip8->memory[address] << 8 | chip8->memory[(uint16_t)(address + 1)],
+                      chip8->quirks);
+    chip8->decodedPages |= (uint64_t)1 << (address >> MEMORY_PAGE_SHIFT);
+    return entry;
+}
+
+// Handler stored in entries that haven't been decoded, or were invalidated. Decodes the
+// instruction, replaces itself in the cache, then runs the real handler.
+static void decodeAndExecute(Chip8 *chip8, const Instruction *ins) {
+    Instruction *entry = decodeEntry(chip8, chip8->pc);
+    (void)ins;
+    chip8->opcode = entry->opcode;
+    entry->handler(chip8, entry);
+}
+
+const Instruction *decodedInstruction(Chip8 *chip8, uint16_t address) {
+    Instruction *entry = &chip8->decoded[address];
+    return entry->handler == decodeAndExecute ? decodeEntry(chip8, address) : entry;
+}
+
+// Which sets of opcodes beyond CHIP-8 each profile decodes
+#define EXTENDS_SCHIP 0x1
+#define EXTENDS_XOCHIP 0x2
+static const uint8_t profileExtensions[QUIRK_PROFILES] = {
+    [QUIRKS_SCHIP] = EXTENDS_SCHIP,
+    [QUIRKS_XOCHIP] = EXTENDS_SCHIP | EXTENDS_XOCHIP,
+};
+
+void decodeInstruction(Instruction *ins, uint16_t opcode, QuirkProfile quirks) {
+    const QuirkHandlers *variant = &quirkHandlers[quirks];
+    int schip = profileExtensions[quirks] & EXTENDS_SCHIP;
+    int xochip = profileExtensions[quirks] & EXTENDS_XOCHIP;
+    ins->opcode = opcode;
+    ins->nnn = opcode & 0x0FFF;
+    ins->x = (opcode & 0x0F00) >> 8;
+    ins->y = (opcode & 0x00F0) >> 4;
+    ins->n = opcode & 0x000F;
+    ins->kk = opcode & 0x00FF;
+
+    OpcodeHandler handler = opcode_unknown;
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            switch (opcode & 0x00FF) {
+                case 0x00E0: handler = opcode_00E0; break;
+                case 0x00EE: handler = opcode_00EE; break;
+                case 0x00FB: if (schip) handler = opcode_00FB; break;
+                case 0x00FC: if (schip) handler = opcode_00FC; break;
+                case 0x00FD: if (schip) handler = opcode_00FD; break;
+                case 0x00FE: if (schip) handler = opcode_00FE; break;
+                case 0x00FF: if (schip) handler = opcode_00FF; break;
+            }
+            switch (opcode & 0x00F0) {
+                case 0x00C0: if (schip) handler = opcode_00Cn; break;
+                case 0x00D0: if (xochip) handler = opcode_00Dn; break;
+            }
+            break;
+        case 0x1000: handler = opcode_1nnn; break;
+        case 0x2000: handler = opcode_2nnn; break;
+        case 0x3000: handler = xochip ? opcode_3xkk_xochip : opcode_3xkk; break;
+        case 0x4000: handler = xochip ? opcode_4xkk_xochip : opcode_4xkk; break;
+        case 0x5000:
+            if (!xochip) {
+                handler = opcode_5xy0;
+                break;
+            }
+            switch (opcode & 0x000F) {
+                case 0x0000: handler = opcode_5xy0_xochip; break;
+                case 0x0002: handler = opcode_5xy2; break;
+                case 0x0003: handler = opcode_5xy3; break;
+            }
+            break;
+        case 0x6000: handler = opcode_6xnn; break;
+        case 0x7000: handler = opcode_7xkk; break;
+        case 0x8000:
+            switch (opcode & 0x000F) {
+                case 0x0000: handler = opcode_8xy0; break;
+                case 0x0001: handler = variant->opcode_8xy1; break;
+                case 0x0002: handler = variant->opcode_8xy2; break;
+                case 0x0003: handler = variant->opcode_8xy3; break;
+                case 0x0004: handler = variant->opcode_8xy4; break;
+                case 0x0005: handler = variant->opcode_8xy5; break;
+                case 0x0006: handler = variant->opcode_8xy6; break;
+                case 0x0007: handler = variant->opcode_8xy7; break;
+                case 0x000E: handler = variant->opcode_8xyE; break;
+            }
+            break;
+        case 0x9000: handler = xochip ? opcode_9xy0_xochip : opcode_9xy0; break;
+        case 0xA000: handler = opcode_Annn; break;
+        case 0xB000: handler = variant->opcode_Bnnn; break;
+        case 0xC000: handler = opcode_Cxkk; break;
+        case 0xD000: handler = variant->opcode_Dxyn; break;
+        case 0xE000:
+            switch (opcode & 0x00FF) {
+                case 0x009E: handler = xochip ? opcode_Ex9E_xochip : opcode_Ex9E; break;
+                case 0x00A1: handler = xochip ? opcode_ExA1_xochip : opcode_ExA1; break;
+            }
+            break;
+        case 0xF000:
+            switch (opcode & 0x00FF) {
+                case 0x0000: if (xochip && opcode == 0xF000) handler = opcode_F000; break;
+                case 0x0001: if (xochip) handler = opcode_Fn01; break;
+                case 0x0002: if (xochip && opcode == 0xF002) handler = opcode_F002; break;
+                case 0x0007: handler = opcode_Fx07; break;
+                case 0x000A: handler = opcode_Fx0A; break;
+                case 0x0015: handler = opcode_Fx15; break;
+                case 0x0018: handler = opcode_Fx18; break;
+                case 0x001E: handler = opcode_Fx1E; break;
+                case 0x0029: handler = opcode_Fx29; break;
+                case 0x0030: if (schip) handler = opcode_Fx30; break;
+                case 0x0033: handler = opcode_Fx33; break;
+                case 0x003A: if (xochip) handler = opcode_Fx3A; break;
+                case 0x0055: handler = variant->opcode_Fx55; break;
+                case 0x0065: handler = variant->opcode_Fx65; break;
+                case 0x0075: if (schip) handler = opcode_Fx75; break;
+                case 0x0085: if (schip) handler = opcode_Fx85; break;
+            }
+            break;
+    }
+    ins->handler = handler;
+}
+
+void predecodeMemory(Chip8 *chip8) {
+    for (int page = 0; page < MEMORY_SIZE >> MEMORY_PAGE_SHIFT; ++page) {
+        if (!(chip8->decodedPages >> page & 1)) {
+            continue;
+        }
+        Instruction *entries = &chip8->decoded[page << MEMORY_PAGE_SHIFT];
+        for (int i = 0; i < 1 << MEMORY_PAGE_SHIFT; ++i) {
+            entries[i].handler = decodeAndExecute;
+        }
+    }
+    chip8->decodedPages = 0;
+    if (chip8->jit != NULL) {
+        flushJit(chip8->jit);
+    }
+}
+
+void invalidateDecoded(Chip8 *chip8, uint16_t address, uint16_t length) {
+    // writes wrap at the end of memory
+    if (address + length > MEMORY_SIZE) {
+        invalidateDecoded(chip8, 0, address + length - MEMORY_SIZE);
+        length = MEMORY_SIZE - address;
+    }
+    // the instruction starting one byte earlier also contains the first written byte
+    int first = address > 0 ? address - 1 : 0;
+    int last = address + length;
+    for (int i = first; i < last; ++i) {
+        chip8->decoded[i].handler = decodeAndExecute;
+    }
+    for (int page = first >> MEMORY_PAGE_SHIFT; page <= (last - 1) >> MEMORY_PAGE_SHIFT; ++page) {
+        chip8->writtenPages |= (uint64_t)1 << page;
+    }
+    if (chip8->jit != NULL) {
+        invalidateJit(chip8->jit, address, length);
+    }
+}
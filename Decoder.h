@@ -0,0 +1,25 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <stdint.h>
+
+#include "Chip8.h"
+
+// Decodes a 2-byte opcode into its handler and operands. The handler is the quirks
+// profile's own for opcodes that differ between platforms.
+void decodeInstruction(Instruction *ins, uint16_t opcode, QuirkProfile quirks);
+
+// Throws the decode cache away after memory or chip8->quirks changed wholesale (a reset,
+// a ROM load, a profile switch). Every entry is decoded again for chip8->quirks the first
+// time it runs. Only the pages in chip8->decodedPages are touched.
+void predecodeMemory(Chip8 *chip8);
+
+// The decoded instruction at address, decoding it first if it hasn't been since the
+// cache was last reset or the memory under it was written
+const Instruction *decodedInstruction(Chip8 *chip8, uint16_t address);
+
+// Must be called after writing length bytes of memory starting at address.
+// Every instruction that overlaps the written bytes is decoded again on next use.
+void invalidateDecoded(Chip8 *chip8, uint16_t address, uint16_t length);
+
+#endif // DECODER_H
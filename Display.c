@@ -1,73 +1,195 @@
+#include <string.h>
+
 #include "Display.h"
 
-int initDisplay(Display *display, const char *title, int width, int height) {
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-        return -1;
-    }
+void initDisplay(Display *display) {
+    memset(display->planes, 0, sizeof(display->planes));
+    display->hires = 0;
+    display->planeMask = 1;
+    display->framesSkipped = 0;
+    display->framesPresented = 0;
+    display->spritesDrawn = 0;
+    markDisplayDirty(display);
+}
 
-    for (int i = 0; i < DISPLAY_WIDTH; ++i) {
-        for (int j = 0; j < DISPLAY_HEIGHT; ++j) {
-            display->pixels[i][j] = 0;
+void clearDisplay(Display *display) {
+    for (int plane = 0; plane < DISPLAY_PLANES; ++plane) {
+        if (!(display->planeMask >> plane & 1)) {
+            continue;
+        }
+        for (int y = 0; y < DISPLAY_HEIGHT; ++y) {
+            // only rows that had something on them change
+            if (display->planes[plane][y] != 0) {
+                display->dirtyRows |= (uint64_t)1 << y;
+                display->planes[plane][y] = 0;
+            }
         }
     }
+}
+
+void setHires(Display *display, int hires) {
+    memset(display->planes, 0, sizeof(display->planes));
+    display->hires = hires != 0;
+    markDisplayDirty(display);
+}
+
+// The bits of a row that are on screen in the current resolution
+static inline DisplayRow visibleBits(const Display *display) {
+    return ~(DisplayRow)0 << (DISPLAY_WIDTH - displayWidth(display));
+}
 
-    display->window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_SHOWN);
-    if (display->window == NULL) {
-        SDL_Quit();
-        return -1;
+// Every sprite draw is an instance of this with width (8 or 16) and clip constant.
+// Each sprite row is moved to the top of a row word (x = 0) and shifted right to x. When
+// wrapping, the pixels shifted past the right edge are rotated back in on the left.
+static inline __attribute__((always_inline))
+uint8_t drawSpriteRows(Display *display, const uint8_t *sprite, int n, uint8_t x, uint8_t y,
+                       int width, int clip) {
+    int screenWidth = displayWidth(display);
+    int screenHeight = displayHeight(display);
+    DisplayRow visible = visibleBits(display);
+    // the sizes are powers of two, so the modulo is a mask
+    int xCoord = x & (screenWidth - 1);
+    int yCoord = y & (screenHeight - 1);
+    int rows = n;
+    if (clip && rows > screenHeight - yCoord) {
+        rows = screenHeight - yCoord;
     }
+    int bytesPerRow = width / 8;
+    display->spritesDrawn++;
 
-    display->renderer = SDL_CreateRenderer(display->window, -1, SDL_RENDERER_ACCELERATED);
-    if (display->renderer == NULL) {
-        SDL_DestroyWindow(display->window);
-        SDL_Quit();
-        return -1;
+    DisplayRow collision = 0;
+    for (int plane = 0; plane < DISPLAY_PLANES; ++plane) {
+        if (!(display->planeMask >> plane & 1)) {
+            continue;
+        }
+        for (int line = 0; line < rows; ++line) {
+            unsigned bits = width == 16 ? sprite[2 * line] << 8 | sprite[2 * line + 1] : sprite[line];
+            DisplayRow spriteRow = (DisplayRow)bits << (DISPLAY_WIDTH - width);
+            if (xCoord != 0) {
+                DisplayRow shifted = spriteRow >> xCoord;
+                if (!clip) {
+                    shifted |= spriteRow << (screenWidth - xCoord);
+                }
+                spriteRow = shifted & visible;
+            }
+
+            int rowIndex = clip ? yCoord + line : (yCoord + line) & (screenHeight - 1);
+            DisplayRow *row = &display->planes[plane][rowIndex];
+            // any bit set in both the sprite and the old row gets toggled off
+            collision |= *row & spriteRow;
+            *row ^= spriteRow;
+            display->dirtyRows |= (uint64_t)(spriteRow != 0) << rowIndex;
+        }
+        // the next plane's data follows this one's
+        sprite += n * bytesPerRow;
     }
+    return collision != 0;
+}
 
-    display->width = width;
-    display->height = height;
+uint8_t drawSprite(Display *display, const uint8_t *sprite, int n, uint8_t x, uint8_t y) {
+    return drawSpriteRows(display, sprite, n, x, y, 8, 0);
+}
 
-    // clear window
-    clearDisplay(display);
+uint8_t drawSpriteClipped(Display *display, const uint8_t *sprite, int n, uint8_t x, uint8_t y) {
+    return drawSpriteRows(display, sprite, n, x, y, 8, 1);
+}
 
-    return 0;
+uint8_t drawWideSprite(Display *display, const uint8_t *sprite, uint8_t x, uint8_t y) {
+    return drawSpriteRows(display, sprite, 16, x, y, 16, 0);
 }
 
-void clearDisplay(Display *display) {
-    for (int i = 0; i < DISPLAY_WIDTH; ++i) {
-        for (int j = 0; j < DISPLAY_HEIGHT; ++j) {
-            display->pixels[i][j] = 0;
+uint8_t drawWideSpriteClipped(Display *display, const uint8_t *sprite, uint8_t x, uint8_t y) {
+    return drawSpriteRows(display, sprite, 16, x, y, 16, 1);
+}
+
+// The rows of the current resolution, as a dirtyRows mask
+static inline uint64_t screenRows(const Display *display) {
+    return display->hires ? ~(uint64_t)0 : ((uint64_t)1 << LORES_HEIGHT) - 1;
+}
+
+void scrollDisplayDown(Display *display, int n) {
+    int height = displayHeight(display);
+    if (n > height) {
+        n = height;
+    }
+    for (int plane = 0; plane < DISPLAY_PLANES; ++plane) {
+        if (display->planeMask >> plane & 1) {
+            DisplayRow *rows = display->planes[plane];
+            memmove(rows + n, rows, (height - n) * sizeof(DisplayRow));
+            memset(rows, 0, n * sizeof(DisplayRow));
+        }
+    }
+    display->dirtyRows |= screenRows(display);
+}
+
+void scrollDisplayUp(Display *display, int n) {
+    int height = displayHeight(display);
+    if (n > height) {
+        n = height;
+    }
+    for (int plane = 0; plane < DISPLAY_PLANES; ++plane) {
+        if (display->planeMask >> plane & 1) {
+            DisplayRow *rows = display->planes[plane];
+            memmove(rows, rows + n, (height - n) * sizeof(DisplayRow));
+            memset(rows + height - n, 0, n * sizeof(DisplayRow));
+        }
+    }
+    display->dirtyRows |= screenRows(display);
+}
+
+void scrollDisplayLeft(Display *display, int n) {
+    // the bits below the visible ones are always clear, so a shift brings in blanks
+    int height = displayHeight(display);
+    for (int plane = 0; plane < DISPLAY_PLANES; ++plane) {
+        if (display->planeMask >> plane & 1) {
+            for (int y = 0; y < height; ++y) {
+                display->planes[plane][y] <<= n;
+            }
         }
     }
-    SDL_SetRenderDrawColor(display->renderer, 0, 0, 0, 255);
-    SDL_RenderClear(display->renderer);
-    SDL_RenderPresent(display->renderer);
+    display->dirtyRows |= screenRows(display);
 }
 
-void updateDisplay(Display *display) {
-    SDL_RenderPresent(display->renderer);
+void scrollDisplayRight(Display *display, int n) {
+    int height = displayHeight(display);
+    DisplayRow visible = visibleBits(display);
+    for (int plane = 0; plane < DISPLAY_PLANES; ++plane) {
+        if (display->planeMask >> plane & 1) {
+            for (int y = 0; y < height; ++y) {
+                display->planes[plane][y] = (display->planes[plane][y] >> n) & visible;
+            }
+        }
+    }
+    display->dirtyRows |= screenRows(display);
 }
 
-void setPixel(Display *display, int x, int y, Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
-    SDL_Rect rect = {x * 10, y * 10, 10, 10};
-    SDL_SetRenderDrawColor(display->renderer, r, g, b, a);
-    SDL_RenderFillRect(display->renderer, &rect);
-    // this should probably eventually be handled here
-    // in an eventual refactor
-    // if (r == 0 && g == 0 && b == 0) {
-    //     display->pixels[x][y] = 0;
-    // } else {
-    //     display->pixels[x][y] = 1;
-    // }
-    //SDL_RenderDrawPoint(display->renderer, x, y);
+void markDisplayDirty(Display *display) {
+    display->dirtyRows = ~(uint64_t)0;
 }
 
-void destroyDisplay(Display *display) {
-    if (display->renderer != NULL) {
-        SDL_DestroyRenderer(display->renderer);
+uint64_t consumeDirtyRows(Display *display) {
+    uint64_t dirty = display->dirtyRows & screenRows(display);
+    display->dirtyRows = 0;
+    if (dirty == 0) {
+        display->framesSkipped++;
+    } else {
+        display->framesPresented++;
     }
-    if (display->window != NULL) {
-        SDL_DestroyWindow(display->window);
+    return dirty;
+}
+
+void displayToPixels(const Display *display, uint32_t *pixels, int firstRow, int lastRow,
+                     const uint32_t colors[4]) {
+    int width = displayWidth(display);
+    for (int y = firstRow; y <= lastRow; ++y) {
+        DisplayRow low = display->planes[0][y];
+        DisplayRow high = display->planes[1][y];
+        uint32_t *out = pixels + y * DISPLAY_WIDTH;
+        for (int x = 0; x < width; ++x) {
+            // walk the rows from the most significant bit (x = 0)
+            out[x] = colors[(int)(low >> (DISPLAY_WIDTH - 1)) | (int)(high >> (DISPLAY_WIDTH - 1)) << 1];
+            low <<= 1;
+            high <<= 1;
+        }
     }
-    SDL_Quit();
-}
\ No newline at end of file
+}
@@ -1,31 +1,94 @@
 #ifndef DISPLAY_H
 #define DISPLAY_H
 
-#include <SDL2/SDL.h>
+#include <stdint.h>
 
-#define DISPLAY_WIDTH 64
-#define DISPLAY_HEIGHT 32
+// The framebuffer is sized for SUPER-CHIP's 128x64 hi-res mode. The original 64x32
+// mode uses the top left quarter of it.
+#define DISPLAY_WIDTH 128
+#define DISPLAY_HEIGHT 64
+#define LORES_WIDTH 64
+#define LORES_HEIGHT 32
+// XO-CHIP draws on two bitplanes, giving four colours. Everything else only uses the first.
+#define DISPLAY_PLANES 2
+
+// One row of the framebuffer. The most significant bit is x = 0, matching the bit order
+// of sprite bytes, so a sprite row is drawn with one XOR and a scroll is one shift.
+typedef unsigned __int128 DisplayRow;
+
+// The emulated framebuffer. This holds no video resources so the core can run
+// without a window; frontends read the pixels once per frame.
 typedef struct {
-    SDL_Window *window;
-    SDL_Renderer *renderer;
-    int width;
-    int height;
-    uint8_t pixels[DISPLAY_WIDTH][DISPLAY_HEIGHT];
+    // planes[p][y]. In lo-res only the top 64 bits of the first 32 rows are used
+    DisplayRow planes[DISPLAY_PLANES][DISPLAY_HEIGHT];
+    // 1 in 128x64 mode (00FF), 0 in 64x32 mode (00FE)
+    uint8_t hires;
+    // bit p is set for each plane that draws, scrolls and clears act on (XO-CHIP Fn01)
+    uint8_t planeMask;
+    // bit y is set when row y of either plane changed since the last present
+    uint64_t dirtyRows;
+    // frames where nothing changed and the present was skipped
+    uint32_t framesSkipped;
+    uint32_t framesPresented;
+    // sprites drawn by any of the drawSprite functions, for the instruction budget tuner (Tuner.h)
+    uint32_t spritesDrawn;
 } Display;
 
-// Function to initialize the display
-int initDisplay(Display *display, const char *title, int width, int height);
+// Function to initialize the display: cleared, lo-res, drawing on the first plane
+void initDisplay(Display *display);
 
-// Function to clear the display
+// Function to clear the selected planes
 void clearDisplay(Display *display);
 
-// Function to update the display
-void updateDisplay(Display *display);
+// Function to switch between 64x32 and 128x64. Clears every plane
+void setHires(Display *display, int hires);
+
+// Function to XOR an n-row sprite onto the display with its top left corner at (x, y).
+// Coordinates wrap, as do pixels that fall off the right or bottom edge.
+// Each selected plane gets the next n bytes of sprite data.
+// Returns 1 if any pixel was switched off (the collision flag for VF).
+uint8_t drawSprite(Display *display, const uint8_t *sprite, int n, uint8_t x, uint8_t y);
+
+// Same as drawSprite, except that only the coordinates wrap. Pixels that fall off the
+// right or bottom edge are dropped, as on the real interpreters.
+uint8_t drawSpriteClipped(Display *display, const uint8_t *sprite, int n, uint8_t x, uint8_t y);
+
+// 16x16 versions of the above for SUPER-CHIP's Dxy0. Two bytes per row, 32 per plane
+uint8_t drawWideSprite(Display *display, const uint8_t *sprite, uint8_t x, uint8_t y);
+uint8_t drawWideSpriteClipped(Display *display, const uint8_t *sprite, uint8_t x, uint8_t y);
+
+// Functions to scroll the selected planes by n pixels of the current resolution.
+// What scrolls in is blank.
+void scrollDisplayDown(Display *display, int n);
+void scrollDisplayUp(Display *display, int n);
+void scrollDisplayLeft(Display *display, int n);
+void scrollDisplayRight(Display *display, int n);
+
+// Function to force the next present to redraw everything (e.g. the window was exposed)
+void markDisplayDirty(Display *display);
+
+// Called by the frontend once per frame. Returns the rows changed since the last
+// present and resets them. A frame with no changes is counted in framesSkipped.
+uint64_t consumeDirtyRows(Display *display);
+
+// Function to expand rows firstRow to lastRow (inclusive) of the current resolution into
+// one 32-bit colour per pixel. colors is indexed by the pixel's plane bits (plane 0 is bit 0).
+// pixels must hold DISPLAY_WIDTH * DISPLAY_HEIGHT entries and is indexed with a row stride
+// of DISPLAY_WIDTH in either resolution.
+void displayToPixels(const Display *display, uint32_t *pixels, int firstRow, int lastRow,
+                     const uint32_t colors[4]);
+
+static inline int displayWidth(const Display *display) {
+    return display->hires ? DISPLAY_WIDTH : LORES_WIDTH;
+}
 
-// Function to set a pixel on the display
-void setPixel(Display *display, int x, int y, Uint8 r, Uint8 g, Uint8 b, Uint8 a);
+static inline int displayHeight(const Display *display) {
+    return display->hires ? DISPLAY_HEIGHT : LORES_HEIGHT;
+}
 
-// Function to destroy the display. Frees up the memory allocated to the renderer and window
-void destroyDisplay(Display *display);
+// Returns 1 if the pixel at (x, y) is on in the first plane
+static inline int getPixel(const Display *display, int x, int y) {
+    return (display->planes[0][y] >> (DISPLAY_WIDTH - 1 - x)) & 1;
+}
 
-#endif // DISPLAY_H
\ No newline at end of file
+#endif // DISPLAY_H
@@ -0,0 +1,520 @@
+// chip8farm - runs many headless CHIP-8 jobs in parallel
+//
+// Usage: chip8farm [--threads N] [--ipf N] [--seed N] [--quirks profile] [--timing vip]
+//                  [--jit | --lockstep] manifest.txt [results.tsv]
+//
+// Each manifest line is one job:   <rom path> <input script or -> <frames>
+// The ROM path may contain spaces. Blank lines and lines starting with # are skipped.
+// An input script has one event per line:   <frame> <key 0-F> <down|up>
+// Events for a frame are applied before that frame runs.
+// Every job starts from CHIP8_DEFAULT_SEED, or with --seed N, job j (counting from 0) uses N + j.
+// --quirks runs every job with that profile (see QuirkProfile in Chip8.h). Lockstep lanes
+// only follow the default one.
+// --timing vip runs each frame for the COSMAC VIP's cycles (see Timing.h) instead of --ipf
+// instructions. It always interprets, so it can't be combined with --jit or --lockstep.
+//
+// Jobs are spread over one worker thread per core. Each worker owns a deque of jobs
+// and takes from its own end; a worker that runs dry steals from the other end of
+// someone else's. Every worker has its own Chip8, so nothing is shared while running.
+//
+// With --lockstep, runs of consecutive jobs with the same ROM and frame count are packed
+// LOCKSTEP_LANES at a time into one Lockstep (see Lockstep.h) and run as a single task.
+// Each of those jobs reports an equal share of its task's time.
+//
+// Results are written in manifest order, one tab separated line per job:
+//   job  rom  frames  instructions  state hash  milliseconds
+// The instruction count is the ROM's, the same whichever way it ran. The rate printed at the
+// end only counts what really ran: the interpreter counts idle loop passes rather than running
+// them (see runChip8), and those are reported separately as skipped.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Chip8.h"
+#include "Jit.h"
+#include "Keypad.h"
+#include "Lockstep.h"
+#include "Profile.h"
+#include "Timing.h"
+
+#define MAX_LINE 4096
+
+typedef struct {
+    int frame;
+    uint8_t key;
+    uint8_t down;
+} InputEvent;
+
+typedef struct {
+    char *rom;
+    // NULL for no input
+    char *inputScript;
+    int frames;
+
+    // results
+    int failed;
+    uint64_t instructions;
+    // of those, the ones counted rather than run
+    uint64_t skipped;
+    uint64_t hash;
+    double milliseconds;
+} Job;
+
+// A unit of work: jobCount consecutive jobs from firstJob. Always one job unless lockstep.
+typedef struct {
+    int firstJob;
+    int jobCount;
+} Task;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int *tasks;
+    // thieves take from top, the owner takes from bottom
+    int top;
+    int bottom;
+} WorkQueue;
+
+typedef struct {
+    int id;
+    pthread_t thread;
+    WorkQueue queue;
+} Worker;
+
+static Job *jobs = NULL;
+static int jobCount = 0;
+static Task *tasks = NULL;
+static int taskCount = 0;
+static Worker *workers = NULL;
+static int workerCount = 0;
+static int instructionsPerFrame = 9;
+static int useJit = 0;
+static int useLockstep = 0;
+static QuirkProfile quirks = QUIRKS_DEFAULT;
+static int vipTiming = 0;
+static int useSeed = 0;
+static uint64_t baseSeed = 0;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int popTask(WorkQueue *queue) {
+    int task = -1;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->bottom > queue->top) {
+        task = queue->tasks[--queue->bottom];
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return task;
+}
+
+static int stealTask(WorkQueue *queue) {
+    int task = -1;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->bottom > queue->top) {
+        task = queue->tasks[queue->top++];
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return task;
+}
+
+// Reads an input script, sorted by frame. Returns the number of events, or -1 if the file
+// can't be read.
+static int loadInputScript(const char *path, InputEvent **events) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    int count = 0;
+    int capacity = 64;
+    *events = malloc(capacity * sizeof(InputEvent));
+
+    char line[MAX_LINE];
+    while (fgets(line, sizeof(line), file)) {
+        int frame;
+        unsigned int key;
+        char action[16];
+        if (sscanf(line, "%d %x %15s", &frame, &key, action) != 3 || key >= KEYS) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity *= 2;
+            *events = realloc(*events, capacity * sizeof(InputEvent));
+        }
+        (*events)[count].frame = frame;
+        (*events)[count].key = key;
+        (*events)[count].down = strcmp(action, "down") == 0;
+        count++;
+    }
+    fclose(file);
+
+    // sorted by frame so a job can walk them in step with its frames. Scripts are usually
+    // in order already, and an insertion sort keeps a frame's events in the order written
+    for (int i = 1; i < count; ++i) {
+        InputEvent event = (*events)[i];
+        int j = i;
+        while (j > 0 && (*events)[j - 1].frame > event.frame) {
+            (*events)[j] = (*events)[j - 1];
+            j--;
+        }
+        (*events)[j] = event;
+    }
+    return count;
+}
+
+// Loads a job's input script, if it has one. Marks the job failed and returns -1 on error.
+static int loadJobInput(Job *job, InputEvent **events) {
+    *events = NULL;
+    if (job->inputScript == NULL) {
+        return 0;
+    }
+    int eventCount = loadInputScript(job->inputScript, events);
+    if (eventCount < 0) {
+        fprintf(stderr, "Failed to open input script %s\n", job->inputScript);
+        job->failed = 1;
+    }
+    return eventCount;
+}
+
+static uint64_t jobSeed(int job) {
+    return useSeed ? baseSeed + job : CHIP8_DEFAULT_SEED;
+}
+
+static void runJob(Chip8 *chip8, Jit *jit, Job *job) {
+    double start = now();
+
+    InputEvent *events;
+    int eventCount = loadJobInput(job, &events);
+    if (eventCount < 0) {
+        return;
+    }
+
+    initializeChip8(chip8);
+    setQuirks(chip8, quirks);
+    // attached after setQuirks so its blocks from the last job are only flushed once, by loadRom
+    chip8->jit = jit;
+    if (loadRom(chip8, job->rom) != 0) {
+        fprintf(stderr, "Failed to open ROM %s\n", job->rom);
+        job->failed = 1;
+        free(events);
+        return;
+    }
+    seedChip8(chip8, jobSeed(job - jobs));
+
+    uint64_t instructions = 0;
+    int nextEvent = 0;
+    for (int frame = 0; frame < job->frames; ++frame) {
+        // events before frame 0 never apply
+        for (; nextEvent < eventCount && events[nextEvent].frame <= frame; ++nextEvent) {
+            if (events[nextEvent].frame < frame) {
+                continue;
+            }
+            if (events[nextEvent].down) {
+                pressKey(chip8, events[nextEvent].key);
+            } else {
+                releaseKey(chip8, events[nextEvent].key);
+            }
+        }
+        if (vipTiming) {
+            instructions += runChip8Cycles(chip8, VIP_FRAME_BUDGET);
+            endVipFrame(chip8);
+        } else {
+            instructions += runChip8(chip8, instructionsPerFrame);
+            updateTimers(chip8);
+        }
+    }
+
+    job->instructions = instructions;
+    job->skipped = chip8->idleInstructions;
+    job->hash = hashChip8(chip8);
+    job->milliseconds = (now() - start) * 1000.0;
+    free(events);
+}
+
+// Runs jobs that share a ROM and frame count together, one per lane
+static void runLockstepTask(Lockstep *lockstep, Chip8 *chip8, const Task *task) {
+    double start = now();
+    Job *group = &jobs[task->firstJob];
+
+    InputEvent *events[LOCKSTEP_LANES];
+    int eventCount[LOCKSTEP_LANES];
+    for (int lane = 0; lane < task->jobCount; ++lane) {
+        eventCount[lane] = loadJobInput(&group[lane], &events[lane]);
+    }
+
+    initializeLockstep(lockstep);
+    if (loadLockstepRom(lockstep, group[0].rom) != 0) {
+        fprintf(stderr, "Failed to open ROM %s\n", group[0].rom);
+        for (int lane = 0; lane < task->jobCount; ++lane) {
+            group[lane].failed = 1;
+        }
+    } else {
+        for (int lane = 0; lane < task->jobCount; ++lane) {
+            seedLane(lockstep, lane, jobSeed(task->firstJob + lane));
+        }
+        int nextEvent[LOCKSTEP_LANES] = {0};
+        for (int frame = 0; frame < group[0].frames; ++frame) {
+            for (int lane = 0; lane < task->jobCount; ++lane) {
+                const InputEvent *laneEvents = events[lane];
+                int *next = &nextEvent[lane];
+                for (; *next < eventCount[lane] && laneEvents[*next].frame <= frame; ++*next) {
+                    if (laneEvents[*next].frame < frame) {
+                        continue;
+                    }
+                    if (laneEvents[*next].down) {
+                        pressLaneKey(lockstep, lane, laneEvents[*next].key);
+                    } else {
+                        releaseLaneKey(lockstep, lane, laneEvents[*next].key);
+                    }
+                }
+            }
+            runLockstep(lockstep, instructionsPerFrame);
+            updateLockstepTimers(lockstep);
+        }
+    }
+
+    double milliseconds = (now() - start) * 1000.0 / task->jobCount;
+    for (int lane = 0; lane < task->jobCount; ++lane) {
+        Job *job = &group[lane];
+        // a lane whose input script is missing still ran, but its result means nothing
+        if (eventCount[lane] >= 0 && !job->failed) {
+            extractLane(lockstep, lane, chip8);
+            job->instructions = lockstep->instructions[lane];
+            job->hash = hashChip8(chip8);
+            job->milliseconds = milliseconds;
+        }
+        free(events[lane]);
+    }
+}
+
+static void *workerMain(void *arg) {
+    Worker *worker = arg;
+    // large and written constantly, so every worker gets its own allocation
+    Chip8 *chip8 = calloc(1, sizeof(Chip8));
+    Jit *jit = useJit ? createJit() : NULL;
+    Lockstep *lockstep = useLockstep ? aligned_alloc(_Alignof(Lockstep), sizeof(Lockstep)) : NULL;
+
+    for (;;) {
+        int task = popTask(&worker->queue);
+        for (int i = 1; task < 0 && i < workerCount; ++i) {
+            task = stealTask(&workers[(worker->id + i) % workerCount].queue);
+        }
+        if (task < 0) {
+            // tasks never create more tasks, so empty everywhere means done
+            break;
+        }
+        if (lockstep != NULL) {
+            runLockstepTask(lockstep, chip8, &tasks[task]);
+        } else {
+            runJob(chip8, jit, &jobs[tasks[task].firstJob]);
+        }
+    }
+
+    free(lockstep);
+    destroyJit(jit);
+    free(chip8);
+    return NULL;
+}
+
+static char *trim(char *text) {
+    while (*text == ' ' || *text == '\t') {
+        text++;
+    }
+    char *end = text + strlen(text);
+    while (end > text && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t')) {
+        *--end = '\0';
+    }
+    return text;
+}
+
+// Splits off the last whitespace separated word of text
+static char *lastWord(char *text) {
+    char *space = strrchr(text, ' ');
+    char *tab = strrchr(text, '\t');
+    if (tab > space) {
+        space = tab;
+    }
+    if (space == NULL) {
+        return NULL;
+    }
+    *space = '\0';
+    return space + 1;
+}
+
+static int loadManifest(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    int capacity = 256;
+    jobs = calloc(capacity, sizeof(Job));
+
+    char buffer[MAX_LINE];
+    while (fgets(buffer, sizeof(buffer), file)) {
+        char *line = trim(buffer);
+        if (*line == '\0' || *line == '#') {
+            continue;
+        }
+        // parsed from the end so the ROM path can contain spaces
+        char *frames = lastWord(line);
+        char *inputScript = frames ? lastWord(trim(line)) : NULL;
+        char *rom = trim(line);
+        if (frames == NULL || inputScript == NULL || *rom == '\0') {
+            fprintf(stderr, "Skipping manifest line: %s\n", line);
+            continue;
+        }
+
+        if (jobCount == capacity) {
+            capacity *= 2;
+            jobs = realloc(jobs, capacity * sizeof(Job));
+        }
+        Job *job = &jobs[jobCount++];
+        memset(job, 0, sizeof(Job));
+        job->rom = strdup(rom);
+        job->inputScript = strcmp(inputScript, "-") == 0 ? NULL : strdup(inputScript);
+        job->frames = atoi(frames);
+    }
+    fclose(file);
+    return jobCount;
+}
+
+int main(int argc, char **argv) {
+    const char *manifestPath = NULL;
+    const char *resultsPath = NULL;
+    workerCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            workerCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ipf") == 0 && i + 1 < argc) {
+            instructionsPerFrame = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            useJit = 1;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            useSeed = 1;
+            baseSeed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--lockstep") == 0) {
+            useLockstep = 1;
+        } else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+            int profile = parseQuirks(argv[++i]);
+            if (profile < 0) {
+                fprintf(stderr, "Unknown quirk profile %s\n", argv[i]);
+                return 1;
+            }
+            quirks = profile;
+        } else if (strcmp(argv[i], "--timing") == 0 && i + 1 < argc) {
+            vipTiming = strcmp(argv[++i], "vip") == 0;
+            if (!vipTiming && strcmp(argv[i], "fixed") != 0) {
+                fprintf(stderr, "Unknown timing %s\n", argv[i]);
+                return 1;
+            }
+        } else if (manifestPath == NULL) {
+            manifestPath = argv[i];
+        } else {
+            resultsPath = argv[i];
+        }
+    }
+    if (manifestPath == NULL) {
+        fprintf(stderr, "Usage: %s [--threads N] [--ipf N] [--seed N] [--quirks profile] [--timing vip] [--jit | --lockstep] manifest.txt [results.tsv]\n", argv[0]);
+        return 1;
+    }
+    if (vipTiming && (useJit || useLockstep)) {
+        fprintf(stderr, "--timing vip always interprets\n");
+        return 1;
+    }
+    if (useLockstep && quirks != QUIRKS_DEFAULT) {
+        fprintf(stderr, "--lockstep only runs the default quirk profile\n");
+        return 1;
+    }
+    if (workerCount < 1) {
+        workerCount = 1;
+    }
+#ifdef CHIP8_PROFILE
+    // the profiler's counters aren't shared safely between threads
+    if (workerCount > 1) {
+        fprintf(stderr, "Profiling, so running one worker instead of %d\n", workerCount);
+        workerCount = 1;
+    }
+#endif
+    if (loadManifest(manifestPath) < 0) {
+        fprintf(stderr, "Failed to open manifest %s\n", manifestPath);
+        return 1;
+    }
+
+    tasks = malloc((jobCount + 1) * sizeof(Task));
+    for (int j = 0; j < jobCount; ++j) {
+        Task *last = taskCount > 0 ? &tasks[taskCount - 1] : NULL;
+        if (useLockstep && last != NULL && last->jobCount < LOCKSTEP_LANES &&
+            strcmp(jobs[last->firstJob].rom, jobs[j].rom) == 0 &&
+            jobs[last->firstJob].frames == jobs[j].frames) {
+            last->jobCount++;
+        } else {
+            tasks[taskCount].firstJob = j;
+            tasks[taskCount].jobCount = 1;
+            taskCount++;
+        }
+    }
+
+    // deal the tasks out round robin. Stealing evens out tasks of different lengths
+    workers = calloc(workerCount, sizeof(Worker));
+    for (int w = 0; w < workerCount; ++w) {
+        workers[w].id = w;
+        pthread_mutex_init(&workers[w].queue.lock, NULL);
+        workers[w].queue.tasks = malloc((taskCount / workerCount + 1) * sizeof(int));
+    }
+    for (int t = 0; t < taskCount; ++t) {
+        WorkQueue *queue = &workers[t % workerCount].queue;
+        queue->tasks[queue->bottom++] = t;
+    }
+
+    double start = now();
+    for (int w = 0; w < workerCount; ++w) {
+        pthread_create(&workers[w].thread, NULL, workerMain, &workers[w]);
+    }
+    for (int w = 0; w < workerCount; ++w) {
+        pthread_join(workers[w].thread, NULL);
+    }
+    double seconds = now() - start;
+
+    FILE *results = stdout;
+    if (resultsPath != NULL) {
+        results = fopen(resultsPath, "w");
+        if (results == NULL) {
+            fprintf(stderr, "Failed to open %s for writing\n", resultsPath);
+            return 1;
+        }
+    }
+    uint64_t totalInstructions = 0;
+    uint64_t totalSkipped = 0;
+    int failures = 0;
+    for (int j = 0; j < jobCount; ++j) {
+        Job *job = &jobs[j];
+        if (job->failed) {
+            fprintf(results, "%d\t%s\tFAILED\n", j, job->rom);
+            failures++;
+            continue;
+        }
+        fprintf(results, "%d\t%s\t%d\t%llu\t%016llx\t%.3f\n", j, job->rom, job->frames,
+                (unsigned long long)job->instructions, (unsigned long long)job->hash, job->milliseconds);
+        totalInstructions += job->instructions;
+        totalSkipped += job->skipped;
+    }
+    if (results != stdout) {
+        fclose(results);
+    }
+
+    fprintf(stderr, "%d jobs (%d failed) on %d threads in %.3fs, %.1f M instructions/s"
+            " (%llu more skipped in idle loops)\n",
+            jobCount, failures, workerCount, seconds, (totalInstructions - totalSkipped) / seconds / 1e6,
+            (unsigned long long)totalSkipped);
+#ifdef CHIP8_PROFILE
+    saveProfileReport("profile.txt");
+#endif
+    return failures > 0;
+}
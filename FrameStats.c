@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "FrameStats.h"
+
+static const char *SeriesNames[SERIES_COUNT] = {"poll", "execute", "render", "present", "busy", "interval"};
+
+// overlay colours per phase, RGB
+static const Uint8 PhaseColors[PHASE_COUNT][3] = {
+    {80, 160, 255},  // poll
+    {80, 220, 80},   // execute
+    {255, 200, 40},  // render
+    {230, 60, 60}    // present
+};
+
+// width of one frame's bar in the overlay, in window pixels
+#define OVERLAY_BAR_WIDTH 4
+// the overlay is half the window tall and spans two 60hz frames
+#define OVERLAY_SPAN_NS (2 * 1000000000u / 60)
+
+static int bucketOf(uint32_t ns) {
+    if (ns < (1u << FRAME_STATS_SUB_BITS)) {
+        return ns;
+    }
+    int shift = 31 - __builtin_clz(ns) - FRAME_STATS_SUB_BITS;
+    return ((shift + 1) << FRAME_STATS_SUB_BITS) + (ns >> shift) - (1 << FRAME_STATS_SUB_BITS);
+}
+
+// The largest value that falls in bucket
+static uint32_t bucketLimit(int bucket) {
+    if (bucket < (1 << FRAME_STATS_SUB_BITS)) {
+        return bucket;
+    }
+    int shift = (bucket >> FRAME_STATS_SUB_BITS) - 1;
+    uint64_t sub = (bucket & ((1 << FRAME_STATS_SUB_BITS) - 1)) + (1 << FRAME_STATS_SUB_BITS);
+    return (uint32_t)(((sub + 1) << shift) - 1);
+}
+
+int initFrameStats(FrameStats *stats) {
+    memset(stats, 0, sizeof(FrameStats));
+    stats->frequency = SDL_GetPerformanceFrequency();
+    stats->history = malloc(FRAME_STATS_HISTORY * sizeof(FrameSample));
+    return stats->history == NULL ? -1 : 0;
+}
+
+void destroyFrameStats(FrameStats *stats) {
+    free(stats->history);
+    stats->history = NULL;
+}
+
+static uint32_t ticksToNs(const FrameStats *stats, Uint64 ticks) {
+    uint64_t ns = (uint64_t)((double)ticks * 1e9 / stats->frequency);
+    return ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+}
+
+void beginFrameStats(FrameStats *stats) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (stats->frameStart != 0) {
+        FrameSample sample;
+        Uint64 busy = 0;
+        for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+            sample.ns[phase] = ticksToNs(stats, stats->phaseTicks[phase]);
+            busy += stats->phaseTicks[phase];
+        }
+        sample.ns[SERIES_BUSY] = ticksToNs(stats, busy);
+        sample.ns[SERIES_INTERVAL] = ticksToNs(stats, now - stats->frameStart);
+
+        for (int series = 0; series < SERIES_COUNT; ++series) {
+            stats->histogram[series][bucketOf(sample.ns[series])]++;
+            if (sample.ns[series] > stats->max[series]) {
+                stats->max[series] = sample.ns[series];
+            }
+        }
+        stats->frames++;
+
+        if (stats->history != NULL) {
+            if (stats->historyCount == FRAME_STATS_HISTORY) {
+                stats->historyFirst = (stats->historyFirst + 1) % FRAME_STATS_HISTORY;
+                stats->historyCount--;
+            }
+            stats->history[(stats->historyFirst + stats->historyCount) % FRAME_STATS_HISTORY] = sample;
+            stats->historyCount++;
+        }
+    }
+    memset(stats->phaseTicks, 0, sizeof(stats->phaseTicks));
+    stats->frameStart = now;
+}
+
+Uint64 endPhase(FrameStats *stats, FramePhase phase, Uint64 start) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    stats->phaseTicks[phase] += now - start;
+    return now;
+}
+
+uint32_t frameStatsPercentile(const FrameStats *stats, int series, double fraction) {
+    if (stats->frames == 0) {
+        return 0;
+    }
+    // the smallest bucket with at least fraction of the frames at or below it
+    uint64_t rank = (uint64_t)(fraction * stats->frames + 0.999999);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < FRAME_STATS_BUCKETS; ++bucket) {
+        seen += stats->histogram[series][bucket];
+        if (seen >= rank) {
+            uint32_t limit = bucketLimit(bucket);
+            // the top bucket is only as high as the largest frame in it
+            return limit < stats->max[series] ? limit : stats->max[series];
+        }
+    }
+    return stats->max[series];
+}
+
+void drawFrameStatsOverlay(const FrameStats *stats, SDL_Renderer *renderer, int width, int height) {
+    int graphHeight = height / 2;
+    int bars = width / OVERLAY_BAR_WIDTH;
+    if (bars > stats->historyCount) {
+        bars = stats->historyCount;
+    }
+
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 160);
+    SDL_Rect background = {0, height - graphHeight, width, graphHeight};
+    SDL_RenderFillRect(renderer, &background);
+
+    // newest frame on the right
+    for (int i = 0; i < bars; ++i) {
+        int index = (stats->historyFirst + stats->historyCount - 1 - i) % FRAME_STATS_HISTORY;
+        const FrameSample *sample = &stats->history[index];
+        int x = width - (i + 1) * OVERLAY_BAR_WIDTH;
+        int y = height;
+        for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+            int h = (int)((uint64_t)sample->ns[phase] * graphHeight / OVERLAY_SPAN_NS);
+            // long frames are cut off at the top of the graph
+            if (h > y - (height - graphHeight)) {
+                h = y - (height - graphHeight);
+            }
+            if (h <= 0) {
+                continue;
+            }
+            SDL_SetRenderDrawColor(renderer, PhaseColors[phase][0], PhaseColors[phase][1],
+                                   PhaseColors[phase][2], 220);
+            SDL_Rect bar = {x, y - h, OVERLAY_BAR_WIDTH - 1, h};
+            SDL_RenderFillRect(renderer, &bar);
+            y -= h;
+        }
+        // the interval as a tick, clamped to the top of the graph
+        uint64_t interval = sample->ns[SERIES_INTERVAL];
+        if (interval > OVERLAY_SPAN_NS) {
+            interval = OVERLAY_SPAN_NS;
+        }
+        int intervalY = height - (int)(interval * graphHeight / OVERLAY_SPAN_NS);
+        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+        SDL_RenderDrawLine(renderer, x, intervalY, x + OVERLAY_BAR_WIDTH - 2, intervalY);
+    }
+
+    // the 60hz budget
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 96);
+    SDL_RenderDrawLine(renderer, 0, height - graphHeight / 2, width, height - graphHeight / 2);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+}
+
+void printFrameStatsSummary(const FrameStats *stats, FILE *out) {
+    if (stats->frames == 0) {
+        return;
+    }
+    fprintf(out, "Frame times over %llu frames (ms):\n", (unsigned long long)stats->frames);
+    fprintf(out, "  %-9s %8s %8s %8s %8s\n", "", "p50", "p95", "p99", "max");
+    for (int series = 0; series < SERIES_COUNT; ++series) {
+        fprintf(out, "  %-9s %8.3f %8.3f %8.3f %8.3f\n", SeriesNames[series],
+                frameStatsPercentile(stats, series, 0.50) / 1e6,
+                frameStatsPercentile(stats, series, 0.95) / 1e6,
+                frameStatsPercentile(stats, series, 0.99) / 1e6,
+                stats->max[series] / 1e6);
+    }
+}
+
+int writeFrameStatsCsv(const FrameStats *stats, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return -1;
+    }
+    // frame numbers count from the first frame still in the history
+    uint64_t firstFrame = stats->frames - stats->historyCount;
+    fprintf(file, "frame");
+    for (int series = 0; series < SERIES_COUNT; ++series) {
+        fprintf(file, ",%s_ms", SeriesNames[series]);
+    }
+    fprintf(file, "\n");
+    for (int i = 0; i < stats->historyCount; ++i) {
+        const FrameSample *sample = &stats->history[(stats->historyFirst + i) % FRAME_STATS_HISTORY];
+        fprintf(file, "%llu", (unsigned long long)(firstFrame + i));
+        for (int series = 0; series < SERIES_COUNT; ++series) {
+            fprintf(file, ",%.4f", sample->ns[series] / 1e6);
+        }
+        fprintf(file, "\n");
+    }
+    return fclose(file) == 0 ? 0 : -1;
+}
@@ -0,0 +1,91 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <SDL2/SDL.h>
+
+// Where the frontend's time goes, frame by frame.
+//
+// Each frame is split into phases timed with the performance counter. Every phase, their
+// sum (busy) and the time from one frame start to the next (interval, which includes the
+// scheduler's sleep) go into a histogram, from which the p50/p95/p99 are read, and into a
+// ring of the most recent frames for the overlay and the CSV.
+
+typedef enum {
+    // SDL_PollEvent and the key handling it leads to
+    PHASE_POLL,
+    // instructions, timers, audio gating and the rewind snapshot
+    PHASE_EXECUTE,
+    // expanding the display to pixels, the texture upload and drawing the overlay
+    PHASE_RENDER,
+    // SDL_RenderPresent. Blocks until the refresh with --vsync
+    PHASE_PRESENT,
+    PHASE_COUNT
+} FramePhase;
+
+// The derived series recorded alongside the phases
+#define SERIES_BUSY PHASE_COUNT
+#define SERIES_INTERVAL (PHASE_COUNT + 1)
+#define SERIES_COUNT (PHASE_COUNT + 2)
+
+// Log-linear buckets of nanoseconds: exact below 64ns, then 64 per power of two (under 2% error)
+#define FRAME_STATS_SUB_BITS 6
+#define FRAME_STATS_BUCKETS ((32 - FRAME_STATS_SUB_BITS + 1) << FRAME_STATS_SUB_BITS)
+
+// Frames kept for the CSV (ten minutes at 60hz). The overlay shows the newest of them.
+#define FRAME_STATS_HISTORY (60 * 60 * 10)
+
+typedef struct {
+    // nanoseconds, indexed by FramePhase then SERIES_BUSY and SERIES_INTERVAL
+    uint32_t ns[SERIES_COUNT];
+} FrameSample;
+
+typedef struct {
+    Uint64 frequency;
+    // counter value the current frame started at. 0 before the first frame
+    Uint64 frameStart;
+    // counter ticks spent in each phase so far this frame
+    Uint64 phaseTicks[PHASE_COUNT];
+
+    uint32_t histogram[SERIES_COUNT][FRAME_STATS_BUCKETS];
+    uint32_t max[SERIES_COUNT];
+    // completed frames
+    uint64_t frames;
+
+    // ring of the newest frames. NULL if it couldn't be allocated
+    FrameSample *history;
+    int historyFirst;
+    int historyCount;
+
+    // drawn over the display, toggled with F3
+    int overlay;
+} FrameStats;
+
+// Returns -1 if the history couldn't be allocated. The histograms work regardless.
+int initFrameStats(FrameStats *stats);
+
+void destroyFrameStats(FrameStats *stats);
+
+// Call when a frame starts. Records the previous frame, if there was one.
+void beginFrameStats(FrameStats *stats);
+
+// Adds the time from start to now to phase and returns now, so consecutive phases can be
+// chained: t = endPhase(stats, PHASE_POLL, t);
+Uint64 endPhase(FrameStats *stats, FramePhase phase, Uint64 start);
+
+// Nanoseconds at or below which the given fraction (0.5, 0.99...) of frames fall, in series
+uint32_t frameStatsPercentile(const FrameStats *stats, int series, double fraction);
+
+// Draws the newest frames as stacked bars along the bottom of the window, with a line at
+// the 60hz budget. Call between drawing the display and presenting.
+void drawFrameStatsOverlay(const FrameStats *stats, SDL_Renderer *renderer, int width, int height);
+
+// One line of p50/p95/p99/max per series
+void printFrameStatsSummary(const FrameStats *stats, FILE *out);
+
+// One row per frame in the history, in milliseconds. Returns 0 on success, -1 on failure.
+int writeFrameStatsCsv(const FrameStats *stats, const char *path);
+
+#endif // FRAMESTATS_H
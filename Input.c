@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "Input.h"
+
+// Keypad layout
+// 1 2 3 C = 1 2 3 4
+// 4 5 6 D = Q W E R
+// 7 8 9 E = A S D F
+// A 0 B F = Z X C V
+SDL_Scancode KeyBindings[KEYS] =
+{
+    SDL_SCANCODE_X, SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3,
+    SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_A,
+    SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_Z, SDL_SCANCODE_C,
+    SDL_SCANCODE_4, SDL_SCANCODE_R, SDL_SCANCODE_F, SDL_SCANCODE_V
+};
+
+// The reverse of KeyBindings, so an event finds its key with one lookup.
+// Holds the CHIP-8 key + 1, or 0 for scancodes that aren't bound
+static uint8_t ScancodeKeys[SDL_NUM_SCANCODES] =
+{
+    [SDL_SCANCODE_X] = 0x0 + 1, [SDL_SCANCODE_1] = 0x1 + 1, [SDL_SCANCODE_2] = 0x2 + 1, [SDL_SCANCODE_3] = 0x3 + 1,
+    [SDL_SCANCODE_Q] = 0x4 + 1, [SDL_SCANCODE_W] = 0x5 + 1, [SDL_SCANCODE_E] = 0x6 + 1, [SDL_SCANCODE_A] = 0x7 + 1,
+    [SDL_SCANCODE_S] = 0x8 + 1, [SDL_SCANCODE_D] = 0x9 + 1, [SDL_SCANCODE_Z] = 0xA + 1, [SDL_SCANCODE_C] = 0xB + 1,
+    [SDL_SCANCODE_4] = 0xC + 1, [SDL_SCANCODE_R] = 0xD + 1, [SDL_SCANCODE_F] = 0xE + 1, [SDL_SCANCODE_V] = 0xF + 1
+};
+
+void bindKey(uint8_t key, SDL_Scancode scancode)
+{
+    ScancodeKeys[KeyBindings[key]] = 0;
+    // a scancode drives one key. Take it away from whichever key had it
+    if (ScancodeKeys[scancode] != 0) {
+        KeyBindings[ScancodeKeys[scancode] - 1] = SDL_SCANCODE_UNKNOWN;
+    }
+    KeyBindings[key] = scancode;
+    ScancodeKeys[scancode] = key + 1;
+}
+
+int loadKeymap(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Can't open keymap %s\n", path);
+        return -1;
+    }
+    char line[256];
+    int lineNumber = 0;
+    int result = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        // trim both ends. Scancode names can have spaces in the middle ("Keypad 0")
+        char *start = line;
+        while (isspace((unsigned char)*start)) {
+            start++;
+        }
+        char *end = start + strlen(start);
+        while (end > start && isspace((unsigned char)end[-1])) {
+            *--end = '\0';
+        }
+        if (*start == '\0') {
+            continue;
+        }
+
+        // one hex digit, whitespace, then the rest of the line is the name
+        unsigned int key;
+        int consumed = 0;
+        if (sscanf(start, "%1x %n", &key, &consumed) != 1 || consumed < 2) {
+            consumed = 0;
+        }
+        SDL_Scancode scancode = consumed ? SDL_GetScancodeFromName(start + consumed) : SDL_SCANCODE_UNKNOWN;
+        if (scancode == SDL_SCANCODE_UNKNOWN) {
+            fprintf(stderr, "%s:%d: expected a key 0-F and a scancode name\n", path, lineNumber);
+            result = -1;
+            continue;
+        }
+        bindKey(key, scancode);
+    }
+    fclose(file);
+    return result;
+}
+
+int keyForEvent(const SDL_Event *event)
+{
+    SDL_Scancode scancode = event->key.keysym.scancode;
+    if (scancode < 0 || scancode >= SDL_NUM_SCANCODES) {
+        return -1;
+    }
+    return ScancodeKeys[scancode] - 1;
+}
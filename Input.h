@@ -0,0 +1,24 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <SDL2/SDL.h>
+
+#include "Keypad.h"
+
+// Keys are bound by scancode, the physical key position, so the default layout is the
+// same block of keys on QWERTY, AZERTY or anything else.
+// The scancode bound to each CHIP-8 key
+extern SDL_Scancode KeyBindings[KEYS];
+
+// Function to bind a CHIP-8 key to a scancode, replacing its old binding
+void bindKey(uint8_t key, SDL_Scancode scancode);
+
+// Function to read bindings from a keymap file. Each line is a CHIP-8 key in hex and an SDL
+// scancode name, e.g. "A Z" or "0 Keypad 0". Keys that aren't listed keep their binding,
+// and # starts a comment. Returns 0 on success, -1 if the file can't be read or a line is bad.
+int loadKeymap(const char *path);
+
+// Function to find the CHIP-8 key a key event is bound to. Returns -1 if it isn't bound
+int keyForEvent(const SDL_Event *event);
+
+#endif // INPUT_H
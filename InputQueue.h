@@ -0,0 +1,66 @@
+#ifndef INPUTQUEUE_H
+#define INPUTQUEUE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// What the window asks of the emulator: key changes and the hotkeys that act on the machine
+typedef enum {
+    INPUT_KEY_DOWN,
+    INPUT_KEY_UP,
+    INPUT_SAVE_STATE,
+    INPUT_LOAD_STATE,
+    INPUT_REWIND_START,
+    INPUT_REWIND_STOP,
+    INPUT_FRAME_ADVANCE,
+    INPUT_QUIT
+} InputType;
+
+typedef struct {
+    uint8_t type;
+    // CHIP-8 key for INPUT_KEY_DOWN/UP
+    uint8_t key;
+} InputCommand;
+
+// Must be a power of two. Far more than a frame's worth of key events
+#define INPUT_QUEUE_SIZE 256
+
+// Single producer, single consumer ring for passing commands from the window thread to
+// the emulator thread without locks. head is only written by the consumer and tail only
+// by the producer; each publishes with a release store that the other acquires.
+typedef struct {
+    InputCommand commands[INPUT_QUEUE_SIZE];
+    _Alignas(64) atomic_uint head;
+    _Alignas(64) atomic_uint tail;
+} InputQueue;
+
+static inline void initInputQueue(InputQueue *queue) {
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+}
+
+// Producer side. Returns 0 (dropping the command) if the queue is full
+static inline int pushInput(InputQueue *queue, InputCommand command) {
+    unsigned tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail - head == INPUT_QUEUE_SIZE) {
+        return 0;
+    }
+    queue->commands[tail % INPUT_QUEUE_SIZE] = command;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+// Consumer side. Returns 0 if the queue is empty
+static inline int popInput(InputQueue *queue, InputCommand *command) {
+    unsigned head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head == tail) {
+        return 0;
+    }
+    *command = queue->commands[head % INPUT_QUEUE_SIZE];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return 1;
+}
+
+#endif // INPUTQUEUE_H
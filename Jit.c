@@ -0,0 +1,493 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Jit.h"
+#include "Decoder.h"
+#include "Opcodes.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+
+#include <sys/mman.h>
+
+// executable memory for compiled blocks. Everything is thrown away when it fills up
+#define CODE_SIZE (4 * 1024 * 1024)
+#define MAX_BLOCKS 16384
+#define MAX_FALLBACKS 65536
+#define MAX_BLOCK_LENGTH 64
+// worst case bytes of native code per instruction (a budget check, a fallback call and an
+// early exit) plus the prologue and epilogue
+#define MAX_INSTRUCTION_CODE 96
+#define MAX_EPILOGUE_CODE 48
+// host page size for mprotect
+#define PAGE_SIZE 4096
+// writes are checked against a bitmap of the memory pages that hold compiled code
+#define CODE_PAGE_SHIFT MEMORY_PAGE_SHIFT
+
+typedef struct {
+    // runs the first limit instructions of the block, or all of them if it's that long
+    void (*entry)(Chip8 *chip8, int limit);
+    uint16_t start;
+    // one past the last byte of the block
+    int end;
+    // number of instructions
+    int length;
+} Block;
+
+struct Jit {
+    uint8_t *code;
+    size_t codeUsed;
+    Block blocks[MAX_BLOCKS];
+    int blockCount;
+    // decoded records passed to interpreter handlers called from compiled code.
+    // These must outlive the blocks, so they live here rather than in chip8->decoded.
+    Instruction fallbacks[MAX_FALLBACKS];
+    int fallbackCount;
+    // compiled block starting at each address, NULL if none
+    Block *blockAt[MEMORY_SIZE];
+    uint64_t codePages;
+    // set if the code buffer's protection couldn't be changed. Nothing more is compiled
+    // and runChip8Jit interprets
+    int disabled;
+};
+
+// x86-64 registers used by the generated code. ebp holds the instruction limit
+#define REG_AL 0
+#define REG_CL 1
+
+typedef struct {
+    uint8_t *p;
+} Emitter;
+
+static void emit8(Emitter *e, uint8_t value) {
+    *e->p++ = value;
+}
+
+static void emit16(Emitter *e, uint16_t value) {
+    memcpy(e->p, &value, 2);
+    e->p += 2;
+}
+
+static void emit32(Emitter *e, uint32_t value) {
+    memcpy(e->p, &value, 4);
+    e->p += 4;
+}
+
+static void emit64(Emitter *e, uint64_t value) {
+    memcpy(e->p, &value, 8);
+    e->p += 8;
+}
+
+// ModRM for [rbx + disp32]. rbx holds the Chip8 pointer for the whole block.
+static void emitField(Emitter *e, int reg, size_t offset) {
+    emit8(e, 0x80 | (reg << 3) | 3);
+    emit32(e, (uint32_t)offset);
+}
+
+#define V_OFFSET(x) (offsetof(Chip8, V) + (x))
+
+// mov word [rbx + offset], imm16
+static void emitStore16(Emitter *e, size_t offset, uint16_t value) {
+    emit8(e, 0x66);
+    emit8(e, 0xC7);
+    emitField(e, 0, offset);
+    emit16(e, value);
+}
+
+// mov al, byte [rbx + from]; mov byte [rbx + to], al
+static void emitCopy8(Emitter *e, size_t to, size_t from) {
+    emit8(e, 0x8A);
+    emitField(e, REG_AL, from);
+    emit8(e, 0x88);
+    emitField(e, REG_AL, to);
+}
+
+// Stores pc for a skip instruction at address. The condition has already been compared:
+// pc = address + 2 + 2 * condition
+static void emitSkip(Emitter *e, uint8_t setcc, uint16_t address) {
+    emit8(e, 0x0F); // setcc al
+    emit8(e, setcc);
+    emit8(e, 0xC0);
+    emit8(e, 0x8D); // lea eax, [rax * 2 + address + 2]
+    emit8(e, 0x04);
+    emit8(e, 0x45);
+    emit32(e, address + 2);
+    emit8(e, 0x66); // mov word [rbx + pc], ax
+    emit8(e, 0x89);
+    emitField(e, REG_AL, offsetof(Chip8, pc));
+}
+
+#define SETE 0x94
+#define SETNE 0x95
+
+// movzx eax, byte [sp]; and eax, STACK_SIZE - 1. The stack wraps like the interpreter's
+static void emitStackSlot(Emitter *e) {
+    emit8(e, 0x0F);
+    emit8(e, 0xB6);
+    emitField(e, REG_AL, offsetof(Chip8, sp));
+    emit8(e, 0x83);
+    emit8(e, 0xE0);
+    emit8(e, STACK_SIZE - 1);
+}
+
+// add rsp, 8; pop rbp; pop rbx; ret
+static void emitReturn(Emitter *e) {
+    emit8(e, 0x48);
+    emit8(e, 0x83);
+    emit8(e, 0xC4);
+    emit8(e, 0x08);
+    emit8(e, 0x5D);
+    emit8(e, 0x5B);
+    emit8(e, 0xC3);
+}
+
+// Calls ins->handler(chip8, ins) with pc set to the instruction's address
+static void emitFallback(Emitter *e, const Instruction *ins, uint16_t address) {
+    emitStore16(e, offsetof(Chip8, pc), address);
+    emit8(e, 0x48); // mov rdi, rbx
+    emit8(e, 0x89);
+    emit8(e, 0xDF);
+    emit8(e, 0x48); // mov rsi, imm64
+    emit8(e, 0xBE);
+    emit64(e, (uint64_t)(uintptr_t)ins);
+    emit8(e, 0x48); // mov rax, imm64
+    emit8(e, 0xB8);
+    emit64(e, (uint64_t)(uintptr_t)ins->handler);
+    emit8(e, 0xFF); // call rax
+    emit8(e, 0xD0);
+}
+
+// XO-CHIP's skips of the register compares, which the recompiler doesn't emit itself
+static int isXochipSkip(OpcodeHandler handler) {
+    return handler == opcode_3xkk_xochip || handler == opcode_4xkk_xochip
+        || handler == opcode_5xy0_xochip || handler == opcode_9xy0_xochip;
+}
+
+// Handlers that change control flow, halt, or write memory. A block always ends after one.
+static int endsBlock(OpcodeHandler handler) {
+    return handler == opcode_00EE || handler == opcode_2nnn || isHandlerFor(handler, opcode_Bnnn)
+        || isHandlerFor(handler, opcode_Ex9E) || isHandlerFor(handler, opcode_ExA1)
+        || handler == opcode_Fx0A || handler == opcode_Fx33 || isHandlerFor(handler, opcode_Fx55)
+        || handler == opcode_unknown || handler == opcode_00FD || handler == opcode_5xy2
+        || handler == opcode_F000 || isXochipSkip(handler);
+}
+
+// Emits one instruction. Returns 1 if it ends the block (pc has been stored).
+static int emitInstruction(Jit *jit, Emitter *e, const Instruction *decoded, uint16_t address) {
+    OpcodeHandler handler = decoded->handler;
+    uint8_t x = decoded->x;
+    uint8_t y = decoded->y;
+
+    if (handler == opcode_1nnn) {
+        emitStore16(e, offsetof(Chip8, pc), decoded->nnn);
+        return 1;
+    } else if (handler == opcode_2nnn) {
+        emit8(e, 0xFE); // inc byte [sp]
+        emitField(e, 0, offsetof(Chip8, sp));
+        emitStackSlot(e);
+        emit8(e, 0x66); // mov word [rbx + rax * 2 + stack], address
+        emit8(e, 0xC7);
+        emit8(e, 0x84);
+        emit8(e, 0x43);
+        emit32(e, offsetof(Chip8, stack));
+        emit16(e, address);
+        emitStore16(e, offsetof(Chip8, pc), decoded->nnn);
+        return 1;
+    } else if (handler == opcode_00EE) {
+        emitStackSlot(e);
+        emit8(e, 0x0F); // movzx ecx, word [rbx + rax * 2 + stack]
+        emit8(e, 0xB7);
+        emit8(e, 0x8C);
+        emit8(e, 0x43);
+        emit32(e, offsetof(Chip8, stack));
+        emit8(e, 0x83); // add ecx, 2
+        emit8(e, 0xC1);
+        emit8(e, 0x02);
+        emit8(e, 0x66); // mov word [pc], cx
+        emit8(e, 0x89);
+        emitField(e, REG_CL, offsetof(Chip8, pc));
+        emit8(e, 0xFE); // dec byte [sp]
+        emitField(e, 1, offsetof(Chip8, sp));
+        return 1;
+    } else if (handler == opcode_3xkk || handler == opcode_4xkk) {
+        emit8(e, 0x31); // xor eax, eax
+        emit8(e, 0xC0);
+        emit8(e, 0x80); // cmp byte [Vx], kk
+        emitField(e, 7, V_OFFSET(x));
+        emit8(e, decoded->kk);
+        emitSkip(e, handler == opcode_3xkk ? SETE : SETNE, address);
+        return 1;
+    } else if (handler == opcode_5xy0 || handler == opcode_9xy0) {
+        emit8(e, 0x31); // xor eax, eax
+        emit8(e, 0xC0);
+        emit8(e, 0x8A); // mov cl, [Vx]
+        emitField(e, REG_CL, V_OFFSET(x));
+        emit8(e, 0x3A); // cmp cl, [Vy]
+        emitField(e, REG_CL, V_OFFSET(y));
+        emitSkip(e, handler == opcode_5xy0 ? SETE : SETNE, address);
+        return 1;
+    } else if (handler == opcode_6xnn) {
+        emit8(e, 0xC6); // mov byte [Vx], kk
+        emitField(e, 0, V_OFFSET(x));
+        emit8(e, decoded->kk);
+        return 0;
+    } else if (handler == opcode_7xkk) {
+        emit8(e, 0x80); // add byte [Vx], kk
+        emitField(e, 0, V_OFFSET(x));
+        emit8(e, decoded->kk);
+        return 0;
+    } else if (handler == opcode_8xy0) {
+        emitCopy8(e, V_OFFSET(x), V_OFFSET(y));
+        return 0;
+    } else if (handler == opcode_8xy1 || handler == opcode_8xy2 || handler == opcode_8xy3) {
+        emit8(e, 0x8A); // mov al, [Vy]
+        emitField(e, REG_AL, V_OFFSET(y));
+        // or/and/xor byte [Vx], al
+        emit8(e, handler == opcode_8xy1 ? 0x08 : handler == opcode_8xy2 ? 0x20 : 0x30);
+        emitField(e, REG_AL, V_OFFSET(x));
+        return 0;
+    } else if (handler == opcode_Annn) {
+        emitStore16(e, offsetof(Chip8, I), decoded->nnn);
+        return 0;
+    } else if (handler == opcode_Fx07) {
+        emitCopy8(e, V_OFFSET(x), offsetof(Chip8, delay_timer));
+        return 0;
+    } else if (handler == opcode_Fx15) {
+        emitCopy8(e, offsetof(Chip8, delay_timer), V_OFFSET(x));
+        return 0;
+    } else if (handler == opcode_Fx18) {
+        emitCopy8(e, offsetof(Chip8, sound_timer), V_OFFSET(x));
+        return 0;
+    } else if (handler == opcode_Fx1E) {
+        emit8(e, 0x0F); // movzx eax, byte [Vx]
+        emit8(e, 0xB6);
+        emitField(e, REG_AL, V_OFFSET(x));
+        emit8(e, 0x66); // add word [I], ax
+        emit8(e, 0x01);
+        emitField(e, REG_AL, offsetof(Chip8, I));
+        return 0;
+    }
+
+    // everything else runs the interpreter's handler
+    Instruction *ins = &jit->fallbacks[jit->fallbackCount++];
+    *ins = *decoded;
+    emitFallback(e, ins, address);
+    return endsBlock(handler);
+}
+
+static void markCodePages(Jit *jit, int start, int end) {
+    for (int page = start >> CODE_PAGE_SHIFT; page <= (end - 1) >> CODE_PAGE_SHIFT; ++page) {
+        jit->codePages |= (uint64_t)1 << page;
+    }
+}
+
+static Block *compileBlock(Jit *jit, Chip8 *chip8, uint16_t start) {
+    if (jit->disabled) {
+        return NULL;
+    }
+    if (jit->codeUsed + MAX_BLOCK_LENGTH * MAX_INSTRUCTION_CODE + MAX_EPILOGUE_CODE > CODE_SIZE
+            || jit->blockCount == MAX_BLOCKS
+            || jit->fallbackCount + MAX_BLOCK_LENGTH > MAX_FALLBACKS) {
+        flushJit(jit);
+    }
+    // only the pages this block can be written into are made writable, and only while compiling
+    uint8_t *entry = jit->code + jit->codeUsed;
+    uint8_t *firstPage = (uint8_t *)((uintptr_t)entry & ~(uintptr_t)(PAGE_SIZE - 1));
+    size_t writableSize = (entry - firstPage) + MAX_BLOCK_LENGTH * MAX_INSTRUCTION_CODE + MAX_EPILOGUE_CODE;
+    if (mprotect(firstPage, writableSize, PROT_READ | PROT_WRITE) != 0) {
+        jit->disabled = 1;
+        return NULL;
+    }
+
+    Emitter e = {entry};
+    emit8(&e, 0x53); // push rbx
+    emit8(&e, 0x55); // push rbp
+    emit8(&e, 0x48); // sub rsp, 8 (aligns the stack for fallback calls)
+    emit8(&e, 0x83);
+    emit8(&e, 0xEC);
+    emit8(&e, 0x08);
+    emit8(&e, 0x48); // mov rbx, rdi
+    emit8(&e, 0x89);
+    emit8(&e, 0xFB);
+    emit8(&e, 0x89); // mov ebp, esi
+    emit8(&e, 0xF5);
+
+    // Before each instruction after the first, leave if the limit has been reached, so a
+    // block longer than what's left of the budget still runs natively up to it.
+    // The exits are emitted after the block, one per instruction.
+    uint8_t *exitJumps[MAX_BLOCK_LENGTH];
+    uint16_t opcodes[MAX_BLOCK_LENGTH];
+    int address = start;
+    int length = 0;
+    int ended = 0;
+    while (!ended && length < MAX_BLOCK_LENGTH && address + 1 < MEMORY_SIZE) {
+        if (length > 0) {
+            emit8(&e, 0x83); // cmp ebp, length
+            emit8(&e, 0xFD);
+            emit8(&e, length);
+            emit8(&e, 0x0F); // je exit, patched below
+            emit8(&e, 0x84);
+            exitJumps[length] = e.p;
+            emit32(&e, 0);
+        }
+        Instruction decoded;
+        opcodes[length] = chip8->memory[address] << 8 | chip8->memory[address + 1];
+        decodeInstruction(&decoded, opcodes[length], chip8->quirks);
+        ended = emitInstruction(jit, &e, &decoded, address);
+        address += 2;
+        length++;
+    }
+
+    Block *block = NULL;
+    if (length > 0) {
+        // the interpreter leaves the last executed opcode in chip8->opcode
+        emitStore16(&e, offsetof(Chip8, opcode), opcodes[length - 1]);
+        if (!ended) {
+            emitStore16(&e, offsetof(Chip8, pc), address);
+        }
+        emitReturn(&e);
+        for (int i = 1; i < length; ++i) {
+            uint32_t offset = (uint32_t)(e.p - (exitJumps[i] + 4));
+            memcpy(exitJumps[i], &offset, 4);
+            emitStore16(&e, offsetof(Chip8, opcode), opcodes[i - 1]);
+            emitStore16(&e, offsetof(Chip8, pc), start + 2 * i);
+            emitReturn(&e);
+        }
+
+        block = &jit->blocks[jit->blockCount++];
+        block->entry = (void (*)(Chip8 *, int))(void *)entry;
+        block->start = start;
+        block->end = address;
+        block->length = length;
+        jit->blockAt[start] = block;
+        markCodePages(jit, start, address);
+        // keep entry points 16-byte aligned
+        jit->codeUsed = ((e.p - jit->code) + 15) & ~(size_t)15;
+    }
+
+    if (mprotect(firstPage, writableSize, PROT_READ | PROT_EXEC) != 0) {
+        // earlier blocks on these pages can't run either
+        flushJit(jit);
+        jit->disabled = 1;
+        return NULL;
+    }
+    return block;
+}
+
+Jit *createJit(void) {
+    Jit *jit = calloc(1, sizeof(Jit));
+    if (jit == NULL) {
+        return NULL;
+    }
+    jit->code = mmap(NULL, CODE_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->code == MAP_FAILED) {
+        free(jit);
+        return NULL;
+    }
+    return jit;
+}
+
+void destroyJit(Jit *jit) {
+    if (jit == NULL) {
+        return;
+    }
+    munmap(jit->code, CODE_SIZE);
+    free(jit);
+}
+
+void flushJit(Jit *jit) {
+    if (jit->blockCount == 0) {
+        // nothing compiled since the last flush, so blockAt is already clear
+        return;
+    }
+    memset(jit->blockAt, 0, sizeof(jit->blockAt));
+    jit->codeUsed = 0;
+    jit->blockCount = 0;
+    jit->fallbackCount = 0;
+    jit->codePages = 0;
+}
+
+void invalidateJit(Jit *jit, uint16_t address, uint16_t length) {
+    if (length == 0) {
+        return;
+    }
+    int end = address + length;
+    if (end > MEMORY_SIZE) {
+        end = MEMORY_SIZE;
+    }
+
+    // most writes (BCD digits, saved registers) land in data, not code
+    int touchesCode = 0;
+    for (int page = address >> CODE_PAGE_SHIFT; page <= (end - 1) >> CODE_PAGE_SHIFT; ++page) {
+        if (jit->codePages & ((uint64_t)1 << page)) {
+            touchesCode = 1;
+            break;
+        }
+    }
+    if (!touchesCode) {
+        return;
+    }
+
+    // The block records and code stay allocated until the next flush, so a block
+    // that overwrites itself can still return safely.
+    for (int i = 0; i < jit->blockCount; ++i) {
+        Block *block = &jit->blocks[i];
+        if (jit->blockAt[block->start] == block && block->start < end && block->end > address) {
+            jit->blockAt[block->start] = NULL;
+        }
+    }
+}
+
+int runChip8Jit(Chip8 *chip8, int count) {
+    Jit *jit = chip8->jit;
+    int executed = 0;
+    while (executed < count && !chip8->waitingForKey) {
+        Block *block = jit->blockAt[chip8->pc];
+        if (block == NULL) {
+            block = compileBlock(jit, chip8, chip8->pc);
+        }
+
+        if (block != NULL) {
+            int limit = count - executed;
+            block->entry(chip8, limit);
+            executed += block->length < limit ? block->length : limit;
+        } else {
+            stepChip8(chip8);
+            executed++;
+        }
+    }
+    return executed;
+}
+
+#else
+
+// No recompiler for this host. runChip8 keeps interpreting.
+
+Jit *createJit(void) {
+    return NULL;
+}
+
+void destroyJit(Jit *jit) {
+    (void)jit;
+}
+
+void flushJit(Jit *jit) {
+    (void)jit;
+}
+
+void invalidateJit(Jit *jit, uint16_t address, uint16_t length) {
+    (void)jit;
+    (void)address;
+    (void)length;
+}
+
+int runChip8Jit(Chip8 *chip8, int count) {
+    int executed = 0;
+    while (executed < count && !chip8->waitingForKey) {
+        stepChip8(chip8);
+        executed++;
+    }
+    return executed;
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdint.h>
+
+#include "Chip8.h"
+
+// Optional x86-64 dynamic recompiler.
+//
+// Straight-line runs of instructions (basic blocks) are translated into native code the
+// first time they are reached. A block ends at the first jump, call, return, skip,
+// Fx0A, Fx33 or Fx55. Register moves, ALU ops without flags, Annn, the timer loads,
+// calls, returns and the skips are emitted natively; everything else (draws, flag-setting
+// 8xy ops, key tests and RNG) calls the interpreter's handler from Opcodes.c, so both
+// backends produce the same state.
+//
+// Attach one with chip8->jit = createJit() and runChip8 will use it.
+// Fx33/Fx55 writes go through invalidateDecoded, which throws away any compiled block
+// that covers the written bytes.
+
+typedef struct Jit Jit;
+
+// Returns NULL if the host is not x86-64 or executable memory can't be allocated.
+// If the code buffer can't be made writable or executable later on, the recompiler
+// stops compiling and runChip8Jit interprets instead.
+Jit *createJit(void);
+
+void destroyJit(Jit *jit);
+
+// Same contract as runChip8. A block longer than the remaining budget stops where the budget
+// runs out, so timers tick at exactly the same instruction as the interpreter.
+int runChip8Jit(Chip8 *chip8, int count);
+
+// Throws away compiled blocks that overlap the given memory range
+void invalidateJit(Jit *jit, uint16_t address, uint16_t length);
+
+// Throws away every compiled block (e.g. after loading a ROM)
+void flushJit(Jit *jit);
+
+#endif // JIT_H
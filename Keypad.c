@@ -1,35 +1,18 @@
 #include "Keypad.h"
 
-// Keypad layout
-// 1 2 3 C = 1 2 3 4
-// 4 5 6 D = Q W E R
-// 7 8 9 E = A S D F
-// A 0 B F = Z X C V
-uint8_t Keypad[KEYS] = 
+void pressKey(Chip8 *chip8, uint8_t key)
 {
-    SDLK_x, SDLK_1, SDLK_2, SDLK_3,
-    SDLK_q, SDLK_w, SDLK_e, SDLK_a,
-    SDLK_s, SDLK_d, SDLK_z, SDLK_c,
-    SDLK_4, SDLK_r, SDLK_f, SDLK_v
-};
+    chip8->keys |= 1 << key;
 
-uint8_t pressedKeys[KEYS] = 
-{
-    0
-};
+    // Fx0A halted the CPU until a key arrived. Store it and move past the wait.
+    if (chip8->waitingForKey) {
+        chip8->V[chip8->keyRegister] = key;
+        chip8->waitingForKey = 0;
+        chip8->pc += 2;
+    }
+}
 
-int checkForKeyPress(SDL_Event *event)
+void releaseKey(Chip8 *chip8, uint8_t key)
 {
-    if (event->type == SDL_KEYDOWN)
-    {
-        for (int i = 0; i < KEYS; i++)
-        {
-            if (event->key.keysym.sym == Keypad[i])
-            {
-                //printf("Key pressed: %x\n", i);
-                return i;
-            }
-        }
-    }
-    return 255;
-}
\ No newline at end of file
+    chip8->keys &= ~(1 << key);
+}
@@ -1,12 +1,20 @@
 #ifndef KEYPAD_H
 #define KEYPAD_H
 
-#include <SDL2/SDL.h>
+#include <stdint.h>
 
-#define KEYS 16
-extern uint8_t Keypad[KEYS];
-extern uint8_t pressedKeys[KEYS];
+#include "Chip8.h"
 
-int checkForKeyPress(SDL_Event *event);
+// Function to mark a CHIP-8 key (0x0 to 0xF) as held.
+// Also completes a pending Fx0A wait.
+void pressKey(Chip8 *chip8, uint8_t key);
 
-#endif // KEYPAD_H
\ No newline at end of file
+// Function to mark a CHIP-8 key as released
+void releaseKey(Chip8 *chip8, uint8_t key);
+
+// Returns 1 if key is held. Values past 0xF are never held.
+static inline int isKeyPressed(const Chip8 *chip8, uint8_t key) {
+    return key < KEYS && (chip8->keys >> key & 1);
+}
+
+#endif // KEYPAD_H
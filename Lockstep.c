@@ -0,0 +1,485 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Lockstep.h"
+#include "Decoder.h"
+#include "Random.h"
+
+// Comparisons between lane vectors give 0 or -1 per lane
+typedef int8_t LaneFlags __attribute__((vector_size(LOCKSTEP_LANES), aligned(LOCKSTEP_LANES)));
+typedef int16_t LaneWideFlags __attribute__((vector_size(LOCKSTEP_LANES * 2), aligned(LOCKSTEP_LANES * 2)));
+
+// Everything below is inlined into runLockstep, which is built once for AVX2 and once
+// for the baseline target (SSE2 on x86-64) and picked at load time.
+#if defined(__x86_64__) && defined(__GNUC__)
+#define LOCKSTEP_TARGETS __attribute__((target_clones("avx2", "default")))
+#else
+#define LOCKSTEP_TARGETS
+#endif
+#define LANE_INLINE static inline __attribute__((always_inline))
+
+// The lanes an instruction runs in, as a bitmask and as vector masks for blending
+typedef struct {
+    uint32_t bits;
+    LaneBytes bytes;
+    LaneWords words;
+} LaneMask;
+
+LANE_INLINE LaneBytes blendBytes(LaneBytes mask, LaneBytes a, LaneBytes b) {
+    return (a & mask) | (b & ~mask);
+}
+
+LANE_INLINE LaneWords blendWords(LaneWords mask, LaneWords a, LaneWords b) {
+    return (a & mask) | (b & ~mask);
+}
+
+LANE_INLINE LaneWords widen(LaneBytes bytes) {
+    return __builtin_convertvector(bytes, LaneWords);
+}
+
+// One bit per lane from a vector of flags. Gathers the low bit of each byte 8 lanes at a time.
+LANE_INLINE uint32_t laneBits(LaneFlags flags) {
+    uint64_t words[LOCKSTEP_LANES / 8];
+    memcpy(words, &flags, sizeof(words));
+    uint32_t bits = 0;
+    for (int i = 0; i < LOCKSTEP_LANES / 8; ++i) {
+        bits |= (uint32_t)(((words[i] & 0x0101010101010101ull) * 0x0102040810204080ull) >> 56) << (i * 8);
+    }
+    return bits;
+}
+
+// Sets pc in the running lanes to pc + 2, or pc + 4 where skip is set.
+// Returns 1 if the lanes went different ways.
+LANE_INLINE int skipIf(Lockstep *lockstep, const LaneMask *mask, uint16_t pc, LaneWideFlags skip) {
+    LaneWords next = ((LaneWords)skip & 2) + (uint16_t)(pc + 2);
+    lockstep->pc = blendWords(mask->words, next, lockstep->pc);
+    uint32_t taken = laneBits(__builtin_convertvector(skip, LaneFlags)) & mask->bits;
+    return taken != 0 && taken != mask->bits;
+}
+
+LANE_INLINE LaneWideFlags widenFlags(LaneFlags flags) {
+    return __builtin_convertvector(flags, LaneWideFlags);
+}
+
+// Same bookkeeping as invalidateDecoded, for the shared decode
+LANE_INLINE void markWritten(Lockstep *lockstep, uint16_t address, uint16_t length) {
+    int first = address > 0 ? address - 1 : 0;
+    for (int i = first; i < address + length; ++i) {
+        lockstep->writtenPages |= (uint64_t)1 << ((i % MEMORY_SIZE) >> MEMORY_PAGE_SHIFT);
+    }
+}
+
+// Executes ins in the lanes in mask, all of which are at pc.
+// Returns 1 if those lanes may no longer be at the same pc or some stopped to wait for a key.
+LANE_INLINE int executeLanes(Lockstep *lockstep, const Instruction *ins, const LaneMask *mask, uint16_t pc) {
+    uint8_t x = ins->x;
+    uint8_t y = ins->y;
+    LaneBytes *V = lockstep->V;
+    LaneBytes m = mask->bytes;
+    LaneWords advance = blendWords(mask->words, lockstep->pc + 2, lockstep->pc);
+    int diverged = 0;
+
+    switch (ins->opcode & 0xF000) {
+        case 0x0000:
+            if (ins->opcode == 0x00E0) {
+                for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+                    if (mask->bits >> lane & 1) {
+                        clearDisplay(&lockstep->display[lane]);
+                    }
+                }
+                lockstep->pc = advance;
+            } else if (ins->opcode == 0x00EE) {
+                int first = -1;
+                for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+                    if (mask->bits >> lane & 1) {
+                        lockstep->pc[lane] = lockstep->stack[lane][lockstep->sp[lane] % STACK_SIZE] + 2;
+                        lockstep->sp[lane]--;
+                        if (first < 0) {
+                            first = lane;
+                        }
+                        diverged |= lockstep->pc[lane] != lockstep->pc[first];
+                    }
+                }
+            } else {
+                goto unknown;
+            }
+            break;
+        case 0x1000:
+            lockstep->pc = blendWords(mask->words, (LaneWords){0} + ins->nnn, lockstep->pc);
+            break;
+        case 0x2000:
+            lockstep->sp = blendBytes(m, lockstep->sp + 1, lockstep->sp);
+            for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+                if (mask->bits >> lane & 1) {
+                    lockstep->stack[lane][lockstep->sp[lane] % STACK_SIZE] = pc;
+                }
+            }
+            lockstep->pc = blendWords(mask->words, (LaneWords){0} + ins->nnn, lockstep->pc);
+            break;
+        case 0x3000:
+            diverged = skipIf(lockstep, mask, pc, widenFlags(V[x] == ins->kk));
+            break;
+        case 0x4000:
+            diverged = skipIf(lockstep, mask, pc, widenFlags(V[x] != ins->kk));
+            break;
+        case 0x5000:
+            diverged = skipIf(lockstep, mask, pc, widenFlags(V[x] == V[y]));
+            break;
+        case 0x6000:
+            V[x] = blendBytes(m, (LaneBytes){0} + ins->kk, V[x]);
+            lockstep->pc = advance;
+            break;
+        case 0x7000:
+            V[x] = blendBytes(m, V[x] + ins->kk, V[x]);
+            lockstep->pc = advance;
+            break;
+        case 0x8000:
+            // Flags are written before the result, in the same order as Opcodes.c, so x or y
+            // being F gives the same answer.
+            switch (ins->n) {
+                case 0x0: V[x] = blendBytes(m, V[y], V[x]); break;
+                case 0x1: V[x] = blendBytes(m, V[x] | V[y], V[x]); break;
+                case 0x2: V[x] = blendBytes(m, V[x] & V[y], V[x]); break;
+                case 0x3: V[x] = blendBytes(m, V[x] ^ V[y], V[x]); break;
+                case 0x4:
+                    V[0xF] = blendBytes(m, (LaneBytes){0} + (uint8_t)(x + y > 255), V[0xF]);
+                    V[x] = blendBytes(m, V[x] + V[y], V[x]);
+                    break;
+                case 0x5:
+                    V[0xF] = blendBytes(m, (LaneBytes)(V[x] > V[y]) & 1, V[0xF]);
+                    V[x] = blendBytes(m, V[x] - V[y], V[x]);
+                    break;
+                case 0x6:
+                    V[0xF] = blendBytes(m, V[x] & 1, V[0xF]);
+                    V[x] = blendBytes(m, V[x] >> 1, V[x]);
+                    break;
+                case 0x7:
+                    V[0xF] = blendBytes(m, (LaneBytes)(V[y] > V[x]) & 1, V[0xF]);
+                    V[x] = blendBytes(m, V[y] - V[x], V[x]);
+                    break;
+                case 0xE:
+                    V[0xF] = blendBytes(m, (LaneBytes)((V[x] & 0x80) == 1) & 1, V[0xF]);
+                    V[x] = blendBytes(m, V[x] << 1, V[x]);
+                    break;
+                default:
+                    goto unknown;
+            }
+            lockstep->pc = advance;
+            break;
+        case 0x9000:
+            diverged = skipIf(lockstep, mask, pc, widenFlags(V[x] != V[y]));
+            break;
+        case 0xA000:
+            lockstep->I = blendWords(mask->words, (LaneWords){0} + ins->nnn, lockstep->I);
+            lockstep->pc = advance;
+            break;
+        case 0xB000:
+            lockstep->pc = blendWords(mask->words, widen(V[0]) + ins->nnn, lockstep->pc);
+            diverged = 1;
+            break;
+        case 0xC000:
+            for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+                if (mask->bits >> lane & 1) {
+                    uint8_t rng = pcg32Next(&lockstep->rngState[lane]) >> 24;
+                    V[x][lane] = rng & ins->kk;
+                }
+            }
+            lockstep->pc = advance;
+            break;
+        case 0xD000:
+            for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+                if (mask->bits >> lane & 1) {
+                    const uint8_t *memory = lockstep->memory[lane];
+                    uint16_t I = lockstep->I[lane] % MEMORY_SIZE;
+                    uint8_t sprite[16];
+                    for (int row = 0; row < ins->n; ++row) {
+                        sprite[row] = memory[(I + row) % MEMORY_SIZE];
+                    }
+                    V[0xF][lane] = drawSprite(&lockstep->display[lane], sprite, ins->n, V[x][lane], V[y][lane]);
+                }
+            }
+            lockstep->pc = advance;
+            break;
+        case 0xE000: {
+            // same as isKeyPressed
+            LaneWords key = widen(V[x]);
+            LaneWideFlags pressed = (key < KEYS) & (((lockstep->keys >> (key & 0xF)) & 1) != 0);
+            if (ins->kk == 0x9E) {
+                diverged = skipIf(lockstep, mask, pc, pressed);
+            } else if (ins->kk == 0xA1) {
+                diverged = skipIf(lockstep, mask, pc, ~pressed);
+            } else {
+                goto unknown;
+            }
+            break;
+        }
+        case 0xF000:
+            switch (ins->kk) {
+                case 0x07: V[x] = blendBytes(m, lockstep->delay_timer, V[x]); break;
+                case 0x0A:
+                    // halt the lanes until pressLaneKey, without moving pc
+                    lockstep->waitingForKey |= m;
+                    for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+                        if (mask->bits >> lane & 1) {
+                            lockstep->keyRegister[lane] = x;
+                        }
+                    }
+                    return 1;
+                case 0x15: lockstep->delay_timer = blendBytes(m, V[x], lockstep->delay_timer); break;
+                case 0x18: lockstep->sound_timer = blendBytes(m, V[x], lockstep->sound_timer); break;
+                case 0x1E: lockstep->I = blendWords(mask->words, lockstep->I + widen(V[x]), lockstep->I); break;
+                case 0x29: lockstep->I = blendWords(mask->words, widen(V[x]) * 5, lockstep->I); break;
+                case 0x33:
+                    for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+                        if (mask->bits >> lane & 1) {
+                            uint8_t *memory = lockstep->memory[lane];
+                            uint16_t I = lockstep->I[lane];
+                            uint8_t value = V[x][lane];
+                            memory[I % MEMORY_SIZE] = (value / 100) % 10;
+                            memory[(I + 1) % MEMORY_SIZE] = (value / 10) % 10;
+                            memory[(I + 2) % MEMORY_SIZE] = value % 10;
+                            markWritten(lockstep, I, 3);
+                        }
+                    }
+                    break;
+                case 0x55:
+                    for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+                        if (mask->bits >> lane & 1) {
+                            uint16_t I = lockstep->I[lane];
+                            for (int i = 0; i <= x; ++i) {
+                                lockstep->memory[lane][(I + i) % MEMORY_SIZE] = V[i][lane];
+                            }
+                            markWritten(lockstep, I, x + 1);
+                        }
+                    }
+                    break;
+                case 0x65:
+                    for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+                        if (mask->bits >> lane & 1) {
+                            uint16_t I = lockstep->I[lane];
+                            for (int i = 0; i <= x; ++i) {
+                                V[i][lane] = lockstep->memory[lane][(I + i) % MEMORY_SIZE];
+                            }
+                        }
+                    }
+                    break;
+                default:
+                    goto unknown;
+            }
+            lockstep->pc = advance;
+            break;
+        unknown:
+        default:
+            // like opcode_unknown, pc stays put and the lanes spin here until they run out
+            fprintf(stderr, "Unknown opcode: %04X\n", ins->opcode);
+            break;
+    }
+    return diverged;
+}
+
+// Decodes every address of the first lane's memory. The lanes all run the same program
+static void decodeLockstepMemory(Lockstep *lockstep) {
+    const uint8_t *memory = lockstep->memory[0];
+    for (int address = 0; address < MEMORY_SIZE; ++address) {
+        decodeInstruction(&lockstep->decoded[address],
+                          memory[address] << 8 | memory[(address + 1) % MEMORY_SIZE], QUIRKS_DEFAULT);
+    }
+}
+
+void initializeLockstep(Lockstep *lockstep) {
+    // every lane starts as a copy of a freshly initialized machine
+    Chip8 *chip8 = malloc(sizeof(Chip8));
+    initializeChip8(chip8);
+
+    for (int r = 0; r < GENERAL_REGISTER_COUNT; ++r) {
+        lockstep->V[r] = (LaneBytes){0};
+    }
+    lockstep->I = (LaneWords){0};
+    lockstep->pc = (LaneWords){0} + chip8->pc;
+    lockstep->sp = (LaneBytes){0};
+    lockstep->delay_timer = (LaneBytes){0};
+    lockstep->sound_timer = (LaneBytes){0};
+    lockstep->keys = (LaneWords){0};
+    lockstep->waitingForKey = (LaneBytes){0};
+    for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+        lockstep->keyRegister[lane] = 0;
+        lockstep->rngState[lane] = chip8->rngState;
+        memset(lockstep->stack[lane], 0, sizeof(lockstep->stack[lane]));
+        memcpy(lockstep->memory[lane], chip8->memory, MEMORY_SIZE);
+        initDisplay(&lockstep->display[lane]);
+        lockstep->instructions[lane] = 0;
+    }
+    decodeLockstepMemory(lockstep);
+    lockstep->writtenPages = 0;
+    lockstep->steps = 0;
+    lockstep->divergedSteps = 0;
+    free(chip8);
+}
+
+void seedLane(Lockstep *lockstep, int lane, uint64_t seed) {
+    pcg32Seed(&lockstep->rngState[lane], seed);
+}
+
+int loadLockstepRom(Lockstep *lockstep, const char *path) {
+    FILE *rom = fopen(path, "rb");
+    if (rom == NULL) {
+        return -1;
+    }
+    uint8_t data[MEMORY_SIZE - 0x200];
+    size_t size = fread(data, 1, sizeof(data), rom);
+    fclose(rom);
+    return loadLockstepRomData(lockstep, data, size);
+}
+
+int loadLockstepRomData(Lockstep *lockstep, const uint8_t *data, size_t size) {
+    if (size > MEMORY_SIZE - 0x200) {
+        return -1;
+    }
+    for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+        memcpy(lockstep->memory[lane] + 0x200, data, size);
+    }
+    decodeLockstepMemory(lockstep);
+    return 0;
+}
+
+void pressLaneKey(Lockstep *lockstep, int lane, uint8_t key) {
+    lockstep->keys[lane] |= 1 << key;
+
+    // same as pressKey
+    if (lockstep->waitingForKey[lane]) {
+        lockstep->V[lockstep->keyRegister[lane]][lane] = key;
+        lockstep->waitingForKey[lane] = 0;
+        lockstep->pc[lane] += 2;
+    }
+}
+
+void releaseLaneKey(Lockstep *lockstep, int lane, uint8_t key) {
+    lockstep->keys[lane] &= ~(1 << key);
+}
+
+LOCKSTEP_TARGETS
+uint64_t runLockstep(Lockstep *lockstep, int count) {
+    int remaining[LOCKSTEP_LANES];
+    for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+        remaining[lane] = count;
+    }
+
+    uint64_t executed = 0;
+    for (;;) {
+        // Run the lanes at the lowest pc first. Lanes that went ahead wait for
+        // the ones behind them, which gives the groups a chance to merge again.
+        uint32_t active = 0;
+        uint32_t group = 0;
+        uint16_t pc = 0xFFFF;
+        int budget = count;
+        for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+            if (remaining[lane] == 0 || lockstep->waitingForKey[lane]) {
+                continue;
+            }
+            active |= (uint32_t)1 << lane;
+            uint16_t lanePc = lockstep->pc[lane];
+            if (lanePc < pc) {
+                pc = lanePc;
+                group = 0;
+                budget = count;
+            }
+            if (lanePc == pc) {
+                group |= (uint32_t)1 << lane;
+                if (remaining[lane] < budget) {
+                    budget = remaining[lane];
+                }
+            }
+        }
+        if (group == 0) {
+            break;
+        }
+
+        LaneMask mask;
+        mask.bits = group;
+        for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+            mask.bytes[lane] = (group >> lane & 1) ? 0xFF : 0;
+            mask.words[lane] = (group >> lane & 1) ? 0xFFFF : 0;
+        }
+
+        // While the group holds every active lane it keeps running until it splits.
+        // Otherwise go back after each instruction to see if other lanes caught up.
+        int run = 0;
+        int diverged = 0;
+        while (run < budget && !diverged) {
+            uint16_t address = pc % MEMORY_SIZE;
+            const Instruction *ins = &lockstep->decoded[address];
+            Instruction fetched;
+            uint64_t pages = (uint64_t)1 << (address >> MEMORY_PAGE_SHIFT)
+                | (uint64_t)1 << (((address + 1) % MEMORY_SIZE) >> MEMORY_PAGE_SHIFT);
+            if (lockstep->writtenPages & pages) {
+                // Code some lane may have overwritten. Fetch it from the first lane, and leave
+                // any lane holding a different opcode for a later group.
+                int first = __builtin_ctz(group);
+                const uint8_t *memory = lockstep->memory[first];
+                uint16_t opcode = memory[address] << 8 | memory[(address + 1) % MEMORY_SIZE];
+                for (int lane = first + 1; lane < LOCKSTEP_LANES; ++lane) {
+                    const uint8_t *laneMemory = lockstep->memory[lane];
+                    if ((group >> lane & 1) &&
+                        (laneMemory[address] << 8 | laneMemory[(address + 1) % MEMORY_SIZE]) != opcode) {
+                        group &= ~((uint32_t)1 << lane);
+                        mask.bytes[lane] = 0;
+                        mask.words[lane] = 0;
+                        diverged = 1;
+                    }
+                }
+                mask.bits = group;
+                decodeInstruction(&fetched, opcode, QUIRKS_DEFAULT);
+                ins = &fetched;
+            }
+
+            diverged |= executeLanes(lockstep, ins, &mask, pc);
+            run++;
+            if (group != active) {
+                break;
+            }
+            pc = lockstep->pc[__builtin_ctz(group)];
+        }
+
+        int lanes = __builtin_popcount(group);
+        executed += (uint64_t)run * lanes;
+        lockstep->steps += run;
+        if (group != active) {
+            lockstep->divergedSteps += run;
+        }
+        for (int lane = 0; lane < LOCKSTEP_LANES; ++lane) {
+            if (group >> lane & 1) {
+                remaining[lane] -= run;
+                lockstep->instructions[lane] += run;
+            }
+        }
+    }
+    return executed;
+}
+
+void updateLockstepTimers(Lockstep *lockstep) {
+    lockstep->delay_timer -= (LaneBytes)(lockstep->delay_timer > 0) & 1;
+    lockstep->sound_timer -= (LaneBytes)(lockstep->sound_timer > 0) & 1;
+}
+
+void extractLane(const Lockstep *lockstep, int lane, Chip8 *chip8) {
+    memcpy(chip8->memory, lockstep->memory[lane], MEMORY_SIZE);
+    for (int r = 0; r < GENERAL_REGISTER_COUNT; ++r) {
+        chip8->V[r] = lockstep->V[r][lane];
+    }
+    chip8->I = lockstep->I[lane];
+    chip8->pc = lockstep->pc[lane];
+    memcpy(chip8->stack, lockstep->stack[lane], sizeof(chip8->stack));
+    chip8->sp = lockstep->sp[lane];
+    chip8->delay_timer = lockstep->delay_timer[lane];
+    chip8->sound_timer = lockstep->sound_timer[lane];
+    chip8->keys = lockstep->keys[lane];
+    chip8->rngState = lockstep->rngState[lane];
+    chip8->waitingForKey = lockstep->waitingForKey[lane] != 0;
+    chip8->keyRegister = lockstep->keyRegister[lane];
+    chip8->display = lockstep->display[lane];
+    chip8->opcode = 0;
+    // pages written by any lane. Only ever makes translated code more careful.
+    chip8->writtenPages = lockstep->writtenPages;
+    predecodeMemory(chip8);
+}
@@ -0,0 +1,88 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <stdint.h>
+
+#include "Chip8.h"
+
+// Runs LOCKSTEP_LANES instances of one ROM together, one instance per vector lane.
+// Each instance has its own registers, memory, screen, keys and random seed, stored
+// structure-of-arrays so an instruction updates every lane with a few vector operations.
+// Instructions are fetched and decoded once for all lanes at the same pc. Lanes whose pc
+// differs (a skip or key test went the other way) are masked off and wait until the
+// others catch up, so the result for each lane is exactly what runChip8 would give.
+// Lanes always follow QUIRKS_DEFAULT.
+
+// 8, 16 or 32
+#ifndef LOCKSTEP_LANES
+#define LOCKSTEP_LANES 16
+#endif
+
+#if LOCKSTEP_LANES != 8 && LOCKSTEP_LANES != 16 && LOCKSTEP_LANES != 32
+#error "LOCKSTEP_LANES must be 8, 16 or 32"
+#endif
+
+// One byte or word per lane. GCC picks SSE or AVX2 registers depending on the target.
+// The alignment is spelled out because GCC caps it at 16 bytes when AVX isn't enabled,
+// but the AVX2 build of runLockstep assumes full alignment.
+typedef uint8_t LaneBytes __attribute__((vector_size(LOCKSTEP_LANES), aligned(LOCKSTEP_LANES)));
+typedef uint16_t LaneWords __attribute__((vector_size(LOCKSTEP_LANES * 2), aligned(LOCKSTEP_LANES * 2)));
+
+typedef struct {
+    // V[r][lane]
+    LaneBytes V[GENERAL_REGISTER_COUNT];
+    LaneWords I;
+    LaneWords pc;
+    LaneBytes sp;
+    LaneBytes delay_timer;
+    LaneBytes sound_timer;
+    // bit k set while key k is held
+    LaneWords keys;
+    // 0xFF in lanes halted by Fx0A
+    LaneBytes waitingForKey;
+    uint8_t keyRegister[LOCKSTEP_LANES];
+
+    uint16_t stack[LOCKSTEP_LANES][STACK_SIZE];
+    uint64_t rngState[LOCKSTEP_LANES];
+    Display display[LOCKSTEP_LANES];
+    uint8_t memory[LOCKSTEP_LANES][MEMORY_SIZE];
+
+    // Decoded from the ROM once for all lanes. Only used for pages no lane has written;
+    // anything else is fetched from each lane's own memory.
+    Instruction decoded[MEMORY_SIZE];
+    // bit n is set once any lane wrote to page n (see MEMORY_PAGE_SHIFT)
+    uint64_t writtenPages;
+
+    // instructions executed by each lane so far
+    uint64_t instructions[LOCKSTEP_LANES];
+    // instruction fetches, and how many of them ran with some lanes masked off
+    uint64_t steps;
+    uint64_t divergedSteps;
+} Lockstep;
+
+// Puts every lane in the state initializeChip8 gives (default seed, no keys held)
+void initializeLockstep(Lockstep *lockstep);
+
+// seedChip8 for one lane
+void seedLane(Lockstep *lockstep, int lane, uint64_t seed);
+
+// Loads the same ROM into every lane. Returns 0 on success, -1 on failure.
+int loadLockstepRom(Lockstep *lockstep, const char *path);
+int loadLockstepRomData(Lockstep *lockstep, const uint8_t *data, size_t size);
+
+// Per lane versions of pressKey and releaseKey
+void pressLaneKey(Lockstep *lockstep, int lane, uint8_t key);
+void releaseLaneKey(Lockstep *lockstep, int lane, uint8_t key);
+
+// Executes up to count instructions in every lane. Like runChip8 a lane stops early
+// while it is waiting for a key. Returns the number of instructions executed over all lanes.
+uint64_t runLockstep(Lockstep *lockstep, int count);
+
+// updateTimers for every lane
+void updateLockstepTimers(Lockstep *lockstep);
+
+// Copies one lane into a Chip8 (and predecodes it), e.g. to hash it or to carry on
+// running it alone. chip8->jit is left as it was.
+void extractLane(const Lockstep *lockstep, int lane, Chip8 *chip8);
+
+#endif // LOCKSTEP_H
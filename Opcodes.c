@@ -1,11 +1,31 @@
 #include "Chip8.h"
 #include "Opcodes.h"
 #include "Keypad.h"
+#include "Decoder.h"
+#include "Random.h"
 
 #include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// the most sprite data one draw can read: a 16x16 sprite for every plane
+#define MAX_SPRITE_BYTES (32 * DISPLAY_PLANES)
+
+// The size bytes of sprite data at I. Memory wraps at the top like every other access
+// through I, so sprites that run past the end are copied out to buffer first
+static inline const uint8_t *spriteAt(const Chip8 *chip8, int size, uint8_t *buffer) {
+    if (chip8->I + size <= MEMORY_SIZE) {
+        return &chip8->memory[chip8->I];
+    }
+    for (int i = 0; i < size; ++i) {
+        buffer[i] = chip8->memory[(uint16_t)(chip8->I + i)];
+    }
+    return buffer;
+}
 
 // 00E0 - CLS
-void opcode_00E0(Chip8 *chip8) {
+void opcode_00E0(Chip8 *chip8, const Instruction *ins) {
     // Clear the display.
     clearDisplay(&chip8->display);
 
@@ -13,39 +33,40 @@ void opcode_00E0(Chip8 *chip8) {
 }
 
 // 00EE - RET
-void opcode_00EE(Chip8 *chip8) {
+void opcode_00EE(Chip8 *chip8, const Instruction *ins) {
     // The interpreter sets the program counter to the address at the top of the stack, 
     // then subtracts 1 from the stack pointer.
-    chip8->pc = chip8->stack[chip8->sp];
+    // Overflowing programs wrap around the stack, as in Lockstep.c
+    chip8->pc = chip8->stack[chip8->sp % STACK_SIZE];
     chip8->sp--;
 
     chip8->pc += 2;
 }
 
 // 1nnn - JP addr
-void opcode_1nnn(Chip8 *chip8) {
+void opcode_1nnn(Chip8 *chip8, const Instruction *ins) {
     // The interpreter sets the program counter to nnn.
-    uint16_t nnn = chip8->opcode & 0x0FFF;
+    uint16_t nnn = ins->nnn;
     chip8->pc = nnn;
 }
 
 // 2nnn - CALL addr
-void opcode_2nnn(Chip8 *chip8) {
+void opcode_2nnn(Chip8 *chip8, const Instruction *ins) {
     // The interpreter increments the stack pointer, 
     // then puts the current PC on the top of the stack. 
     // The PC is then set to nnn.
     chip8->sp++;
-    chip8->stack[chip8->sp] = chip8->pc;
-    chip8->pc = chip8->opcode & 0x0FFF;
+    chip8->stack[chip8->sp % STACK_SIZE] = chip8->pc;
+    chip8->pc = ins->nnn;
 }
 
 // 3xkk - SE Vx, byte
 // (SE =  Set if Equal)
-void opcode_3xkk(Chip8 *chip8) {
+void opcode_3xkk(Chip8 *chip8, const Instruction *ins) {
     // Interpreter compares register V[x] to kk. 
     // If equal, increment the Program Counter by an additional 2 bytes. 
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
-    uint8_t kk = chip8->opcode & 0x00FF;
+    uint8_t x = ins->x;
+    uint8_t kk = ins->kk;
     if (chip8->V[x] == kk) {
         chip8->pc += 2;
     }
@@ -55,11 +76,11 @@ void opcode_3xkk(Chip8 *chip8) {
 
 // 4xkk - SNE Vx, byte
 // (SNE = Skip if Not Equal)
-void opcode_4xkk(Chip8 *chip8) {
+void opcode_4xkk(Chip8 *chip8, const Instruction *ins) {
     // Interpreter compares register V[x] to kk. 
     // If not equal, increment the Program Counter by an additional 2 bytes. 
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
-    uint8_t kk = chip8->opcode & 0x00FF;
+    uint8_t x = ins->x;
+    uint8_t kk = ins->kk;
     if (chip8->V[x] != kk) {
         chip8->pc += 2;
     }
@@ -68,11 +89,11 @@ void opcode_4xkk(Chip8 *chip8) {
 }
 
 // 5xy0 - SE Vx, Vy
-void opcode_5xy0(Chip8 *chip8) {
+void opcode_5xy0(Chip8 *chip8, const Instruction *ins) {
     // The interpreter compares register Vx to register Vy. 
     // If they are equal, increment the program counter by 2.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
-    uint8_t y = (chip8->opcode & 0x00F0) >> 4;
+    uint8_t x = ins->x;
+    uint8_t y = ins->y;
     if (chip8->V[x] == chip8->V[y]) {
         chip8->pc += 2;
     }
@@ -81,72 +102,72 @@ void opcode_5xy0(Chip8 *chip8) {
 }
 
 // 6xnn - LD Vx, byte
-void opcode_6xnn(Chip8 *chip8) {
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
-    uint8_t nn = chip8->opcode & 0x00FF;
+void opcode_6xnn(Chip8 *chip8, const Instruction *ins) {
+    uint8_t x = ins->x;
+    uint8_t nn = ins->kk;
     chip8->V[x] = nn;
 
     chip8->pc += 2;
 }
 
 // 7xkk - ADD Vx, byte
-void opcode_7xkk(Chip8 *chip8) {
+void opcode_7xkk(Chip8 *chip8, const Instruction *ins) {
     // Adds the value kk to the value of register Vx, then stores the result in Vx.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
-    uint8_t kk = chip8->opcode & 0x00FF;
+    uint8_t x = ins->x;
+    uint8_t kk = ins->kk;
     chip8->V[x] += kk;
 
     chip8->pc += 2;
 }
 
 // 8xy0 - LD Vx, Vy
-void opcode_8xy0(Chip8 *chip8) {
+void opcode_8xy0(Chip8 *chip8, const Instruction *ins) {
     // Stores the value of register Vy in register Vx.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
-    uint8_t y = (chip8->opcode & 0x00F0) >> 4;
+    uint8_t x = ins->x;
+    uint8_t y = ins->y;
     chip8->V[x] = chip8->V[y];
 
     chip8->pc += 2;
 }
 
 // 8xy1 - OR Vx, Vy
-void opcode_8xy1(Chip8 *chip8) {
+void opcode_8xy1(Chip8 *chip8, const Instruction *ins) {
     // Performs a bitwise OR on the values of Vx and Vy, then stores the result in Vx.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
-    uint8_t y = (chip8->opcode & 0x00F0) >> 4;
+    uint8_t x = ins->x;
+    uint8_t y = ins->y;
     chip8->V[x] |= chip8->V[y];
 
     chip8->pc += 2;
 }
 
 // 8xy2 - AND Vx, Vy
-void opcode_8xy2(Chip8 *chip8) {
+void opcode_8xy2(Chip8 *chip8, const Instruction *ins) {
     // Performs a bitwise AND on the values of Vx and Vy, then stores the result in Vx.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
-    uint8_t y = (chip8->opcode & 0x00F0) >> 4;
+    uint8_t x = ins->x;
+    uint8_t y = ins->y;
     chip8->V[x] &= chip8->V[y];
 
     chip8->pc += 2;
 }
 
 // 8xy3 - XOR Vx, Vy
-void opcode_8xy3(Chip8 *chip8) {
+void opcode_8xy3(Chip8 *chip8, const Instruction *ins) {
     // Performs a bitwise exclusive OR on the values of Vx and Vy, then stores the result in Vx.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
-    uint8_t y = (chip8->opcode & 0x00F0) >> 4;
+    uint8_t x = ins->x;
+    uint8_t y = ins->y;
     chip8->V[x] ^= chip8->V[y];
 
     chip8->pc += 2;
 }
 
 // 8xy4 - ADD Vx, Vy
-void opcode_8xy4(Chip8 *chip8) {
+void opcode_8xy4(Chip8 *chip8, const Instruction *ins) {
     // Set Vx = Vx + Vy, set VF = carry.
     // The values of Vx and Vy are added together. 
     // If the result is greater than 8 bits (i.e., > 255,) VF is set to 1, otherwise 0. 
     // Only the lowest 8 bits of the result are kept, and stored in Vx.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
-    uint8_t y = (chip8->opcode & 0x00F0) >> 4;
+    uint8_t x = ins->x;
+    uint8_t y = ins->y;
     if (x + y > 255) {
         chip8->V[0xF] = 1;
     } else {
@@ -158,12 +179,12 @@ void opcode_8xy4(Chip8 *chip8) {
 }
 
 // 8xy5 - SUB Vx, Vy
-void opcode_8xy5(Chip8 *chip8) {
+void opcode_8xy5(Chip8 *chip8, const Instruction *ins) {
     // Set Vx = Vx - Vy, set VF = NOT borrow.
     // If Vx > Vy, then VF is set to 1, otherwise 0. 
     // Then Vy is subtracted from Vx, and the results stored in Vx.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
-    uint8_t y = (chip8->opcode & 0x00F0) >> 4;
+    uint8_t x = ins->x;
+    uint8_t y = ins->y;
     if (chip8->V[x] > chip8->V[y]) {
         chip8->V[0xF] = 1;
     } else {
@@ -176,11 +197,11 @@ void opcode_8xy5(Chip8 *chip8) {
 
 // 8xy6 - SHR Vx {, Vy}
 // SHR is shift right (bitwise operation).
-void opcode_8xy6(Chip8 *chip8) {
+void opcode_8xy6(Chip8 *chip8, const Instruction *ins) {
     // Set Vx = Vx SHR 1.
     // If the least-significant bit of Vx is 1, then VF is set to 1, otherwise 0. 
     // Then Vx is divided by 2. (bitshift right by 1)
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
+    uint8_t x = ins->x;
     uint8_t lsb = chip8->V[x] & 0x1;
     if (lsb == 1) {
         chip8->V[0xF] = 1;
@@ -193,12 +214,12 @@ void opcode_8xy6(Chip8 *chip8) {
 }
 
 // 8xy7 - SUBN Vx, Vy
-void opcode_8xy7(Chip8 *chip8) {
+void opcode_8xy7(Chip8 *chip8, const Instruction *ins) {
     // Set Vx = Vy - Vx, set VF = NOT borrow.
     // If Vy > Vx, then VF is set to 1, otherwise 0. 
     // Then Vx is subtracted from Vy, and the results stored in Vx.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
-    uint8_t y = (chip8->opcode & 0x00F0) >> 4;
+    uint8_t x = ins->x;
+    uint8_t y = ins->y;
     if (chip8->V[y] > chip8->V[x]) {
         chip8->V[0xF] = 1;
     } else {
@@ -211,11 +232,11 @@ void opcode_8xy7(Chip8 *chip8) {
 
 // 8xyE - SHL Vx {, Vy}
 // SHL is shift left (bitwise operation).
-void opcode_8xyE(Chip8 *chip8) {
+void opcode_8xyE(Chip8 *chip8, const Instruction *ins) {
     // Set Vx = Vx SHL 1.
     // If the most-significant bit of Vx is 1, then VF is set to 1, otherwise 0. 
     // Then Vx is multiplied by 2. (bitshift left by 1)
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
+    uint8_t x = ins->x;
     uint8_t msb = chip8->V[x] & 0x80; // 1000 0000
     if (msb == 1) {
         chip8->V[0xF] = 1;
@@ -228,11 +249,11 @@ void opcode_8xyE(Chip8 *chip8) {
 }
 
 // 9xy0 - SNE Vx, Vy
-void opcode_9xy0(Chip8 *chip8) {
+void opcode_9xy0(Chip8 *chip8, const Instruction *ins) {
     // The interpreter compares register Vx to register Vy. 
     // If they are not equal, increment the program counter by 2.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
-    uint8_t y = (chip8->opcode & 0x00F0) >> 4;
+    uint8_t x = ins->x;
+    uint8_t y = ins->y;
     if (chip8->V[x] != chip8->V[y]) {
         chip8->pc += 2;
     }
@@ -241,26 +262,27 @@ void opcode_9xy0(Chip8 *chip8) {
 }
 
 // Annn - LD I, addr
-void opcode_Annn(Chip8 *chip8) {
-    chip8->I = chip8->opcode & 0x0FFF;
+void opcode_Annn(Chip8 *chip8, const Instruction *ins) {
+    chip8->I = ins->nnn;
 
     chip8->pc += 2;
 }
 
 // Bnnn - JP V0, addr
-void opcode_Bnnn(Chip8 *chip8) {
+void opcode_Bnnn(Chip8 *chip8, const Instruction *ins) {
     // The program counter is set to nnn plus the value of V0.
-    uint16_t nnn = chip8->opcode & 0x0FFF;
+    uint16_t nnn = ins->nnn;
     chip8->pc = nnn + chip8->V[0x0];
 }
 
 // Cxkk - RND Vx, byte
-void opcode_Cxkk(Chip8 *chip8) {
+void opcode_Cxkk(Chip8 *chip8, const Instruction *ins) {
     // The interpreter generates a random number from 0 to 255, 
     // which is then ANDed with the value kk. The results are stored in Vx.
-    uint8_t rng = rand() % 256;
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
-    uint8_t kk = chip8->opcode & 0x00FF;
+    // the top bits of PCG32 are the best ones
+    uint8_t rng = pcg32Next(&chip8->rngState) >> 24;
+    uint8_t x = ins->x;
+    uint8_t kk = ins->kk;
     chip8->V[x] = rng & kk;
 
     chip8->pc += 2;
@@ -273,187 +295,549 @@ void opcode_Cxkk(Chip8 *chip8) {
 // If this causes any pixels to be erased, VF is set to 1, otherwise it is set to 0.
 // If the sprite is positioned so part of it is outside the coordinates of the display,
 // it wraps around to the opposite side of the screen.
-void opcode_Dxyn(Chip8 *chip8) {
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
-    uint8_t y = (chip8->opcode & 0x00F0) >> 4;
-    uint8_t nBytes = chip8->opcode & 0x000F;
-
-    // each byte represents a row of 8 pixels aka 1 yline
-    chip8->V[0xF] = 0;
-    for (int yline = 0; yline < nBytes; ++yline) {
-        uint8_t spriteByte = chip8->memory[chip8->I + yline];
-        for (int xline = 0; xline < 8; ++xline) {
-            // 0x80 is 10000000. This is our starting bit mask to test. 
-            // each bit in the Sprite Byte will be tested.
-            if ((spriteByte & (0x80 >> xline)) != 0) {
-                uint8_t xCoord = chip8->V[x] + xline;
-                uint8_t yCoord = chip8->V[y] + yline;
-
-                // modulo operation to wrap around the screen if out of bounds
-                xCoord = xCoord % DISPLAY_WIDTH;
-                yCoord = yCoord % DISPLAY_HEIGHT;
-                
-                chip8->display.pixels[xCoord][yCoord] ^= 1;
-                if (chip8->display.pixels[xCoord][yCoord] == 0) {
-                    // if being toggled and the pixel ends up as off, 
-                    // then collision was detected
-                    chip8->V[0xF] = 1;
-                    setPixel(&chip8->display, xCoord, yCoord, 0, 0, 0, 0);
-                } else {
-                    setPixel(&chip8->display, xCoord, yCoord, RED_VAL, GREEN_VAL, BLUE_VAL, ALPHA_VAL);
-                }
-            }
-            
-        }
-    }
-    updateDisplay(&chip8->display);
+void opcode_Dxyn(Chip8 *chip8, const Instruction *ins) {
+    uint8_t x = ins->x;
+    uint8_t y = ins->y;
+    uint8_t nBytes = ins->n;
+
+    uint8_t buffer[MAX_SPRITE_BYTES];
+    const uint8_t *sprite = spriteAt(chip8, nBytes * DISPLAY_PLANES, buffer);
+    chip8->V[0xF] = drawSprite(&chip8->display, sprite, nBytes, chip8->V[x], chip8->V[y]);
 
     chip8->pc += 2;
 }
 
 // Ex9E - SKP Vx
-void opcode_Ex9E(Chip8 *chip8) {
+void opcode_Ex9E(Chip8 *chip8, const Instruction *ins) {
     // Skip the next instruction if the key stored in Vx is pressed.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
-    uint8_t ch8key = chip8->V[x];
-
-    int foundKeyPresses = 0;
-
-    for (int i = 0; i < KEYS; ++i) {
-        if (pressedKeys[i] == ch8key) {
-            foundKeyPresses++;
-            break;
-        }
-    }
-
-    if (foundKeyPresses > 0) {
+    uint8_t x = ins->x;
+    if (isKeyPressed(chip8, chip8->V[x])) {
         chip8->pc += 2;
     }
     chip8->pc += 2;
 }
 
 // ExA1 - SKNP Vx
-void opcode_ExA1(Chip8 *chip8) {
+void opcode_ExA1(Chip8 *chip8, const Instruction *ins) {
     // Skip the next instruction if the key stored in Vx is not pressed.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
-    uint8_t ch8key = chip8->V[x];
-    
-    int foundKeyPresses = 0;
-
-    for (int i = 0; i < KEYS; ++i) {
-        if (pressedKeys[i] == ch8key) {
-            foundKeyPresses++;
-            break;
-        }
-    }
-
-    if (foundKeyPresses == 0) {
+    uint8_t x = ins->x;
+    if (!isKeyPressed(chip8, chip8->V[x])) {
         chip8->pc += 2;
     }
     chip8->pc += 2;
 }
 
 // Fx07 - LD Vx, DT
-void opcode_Fx07(Chip8 *chip8) {
+void opcode_Fx07(Chip8 *chip8, const Instruction *ins) {
     // Set Vx = delay timer value.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
+    uint8_t x = ins->x;
     chip8->V[x] = chip8->delay_timer;
 
     chip8->pc += 2;
 }
 
 // Fx0A - LD Vx, K
-void opcode_Fx0A(Chip8 *chip8) {
+void opcode_Fx0A(Chip8 *chip8, const Instruction *ins) {
     // Wait for a key press, store the value of the key in Vx.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
-
-    SDL_Event e;
-    uint8_t foundKey = 0;
-    while (1) {
-        while(SDL_PollEvent(&e)) {
-            foundKey = checkForKeyPress(&e);
-            if (foundKey != 255) {
-                chip8->V[x] = foundKey;
-                chip8->pc += 2;
-                return;
-            }
-        }
-    }
+    uint8_t x = ins->x;
+
+    // The core can't block on input, so halt the CPU instead.
+    // pressKey stores the key in Vx and moves the program counter past this instruction.
+    chip8->waitingForKey = 1;
+    chip8->keyRegister = x;
 }
 
 // Fx15 - LD DT, Vx
-void opcode_Fx15(Chip8 *chip8) {
+void opcode_Fx15(Chip8 *chip8, const Instruction *ins) {
     // Set delay timer = Vx.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
+    uint8_t x = ins->x;
     chip8->delay_timer = chip8->V[x];
 
     chip8->pc += 2;
 }
 
 // Fx18 - LD ST, Vx
-void opcode_Fx18(Chip8 *chip8) {
+void opcode_Fx18(Chip8 *chip8, const Instruction *ins) {
     // Set sound timer = Vx.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
+    uint8_t x = ins->x;
     chip8->sound_timer = chip8->V[x];
 
     chip8->pc += 2;
 }
 
 // Fx1E - ADD I, Vx
-void opcode_Fx1E(Chip8 *chip8) {
+void opcode_Fx1E(Chip8 *chip8, const Instruction *ins) {
     // Set I = I + Vx.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
+    uint8_t x = ins->x;
     chip8->I += chip8->V[x];
 
     chip8->pc += 2;
 }
 
 // Fx29 - LD F, Vx
-void opcode_Fx29(Chip8 *chip8) {
+void opcode_Fx29(Chip8 *chip8, const Instruction *ins) {
     // Set I = location of sprite for digit Vx.
     // digit Vx corresponds to the digit in the hexadecimal system.
     // each digit is 5 bytes long. therefore, we need to account for this by skipping
     // 5 bytes for each digit.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
+    uint8_t x = ins->x;
     chip8->I = chip8->V[x] * 5; // each sprite is 5 bytes long
 
     chip8->pc += 2;
 }
 
 // Fx33 - LD B, Vx
-void opcode_Fx33(Chip8 *chip8) {
+void opcode_Fx33(Chip8 *chip8, const Instruction *ins) {
     // Store BCD representation of Vx in memory locations I, I+1, and I+2.
     // Binary Coded Decimal (BCD) is a way to store numbers in memory.
     // Each digit stored in its own nibble (4 bits).
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
+    uint8_t x = ins->x;
     uint8_t value = chip8->V[x];
     // get each digit by shifting the decimal to the right and 
     // masking the last digit with a modulo operation.
     chip8->memory[chip8->I] = (value / 100) % 10;
-    chip8->memory[chip8->I + 1] = (value / 10) % 10;
-    chip8->memory[chip8->I + 2] = value % 10;
+    chip8->memory[(uint16_t)(chip8->I + 1)] = (value / 10) % 10;
+    chip8->memory[(uint16_t)(chip8->I + 2)] = value % 10;
+    invalidateDecoded(chip8, chip8->I, 3);
 
     chip8->pc += 2;
 }
 
 // Fx55 - LD [I], Vx
-void opcode_Fx55(Chip8 *chip8) {
+void opcode_Fx55(Chip8 *chip8, const Instruction *ins) {
     // Store registers V0 through Vx in memory starting at location I.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
+    uint8_t x = ins->x;
     for (int i = 0; i <= x; ++i) {
-        chip8->memory[chip8->I + i] = chip8->V[i];
+        chip8->memory[(uint16_t)(chip8->I + i)] = chip8->V[i];
     }
+    invalidateDecoded(chip8, chip8->I, x + 1);
 
     chip8->pc += 2;
 }
 
 // Fx65 - LD Vx, [I]
-void opcode_Fx65(Chip8 *chip8) {
+void opcode_Fx65(Chip8 *chip8, const Instruction *ins) {
     // Read registers V0 through Vx from memory starting at location I.
-    uint8_t x = (chip8->opcode & 0x0F00) >> 8;
+    uint8_t x = ins->x;
     for (int i = 0; i <= x; ++i) {
-        chip8->V[i] = chip8->memory[chip8->I + i];
+        chip8->V[i] = chip8->memory[(uint16_t)(chip8->I + i)];
+    }
+
+    chip8->pc += 2;
+}
+
+// Any opcode that doesn't decode to one of the above
+void opcode_unknown(Chip8 *chip8, const Instruction *ins) {
+    fprintf(stderr, "Unknown opcode: %04X\n", ins->opcode);
+    (void)chip8;
+}
+
+// SUPER-CHIP additions
+
+// 00Cn - SCD nibble
+void opcode_00Cn(Chip8 *chip8, const Instruction *ins) {
+    // Scroll the display down n pixels.
+    scrollDisplayDown(&chip8->display, ins->n);
+
+    chip8->pc += 2;
+}
+
+// 00FB - SCR
+void opcode_00FB(Chip8 *chip8, const Instruction *ins) {
+    // Scroll the display right 4 pixels.
+    scrollDisplayRight(&chip8->display, 4);
+
+    chip8->pc += 2;
+}
+
+// 00FC - SCL
+void opcode_00FC(Chip8 *chip8, const Instruction *ins) {
+    // Scroll the display left 4 pixels.
+    scrollDisplayLeft(&chip8->display, 4);
+
+    chip8->pc += 2;
+}
+
+// 00FD - EXIT
+void opcode_00FD(Chip8 *chip8, const Instruction *ins) {
+    // Exit the interpreter. There is nothing to return to, so pc stays here and the
+    // machine keeps running this instruction with the last frame on screen.
+    (void)chip8;
+}
+
+// 00FE - LOW
+void opcode_00FE(Chip8 *chip8, const Instruction *ins) {
+    // Switch to the 64x32 mode. The screen is cleared.
+    setHires(&chip8->display, 0);
+
+    chip8->pc += 2;
+}
+
+// 00FF - HIGH
+void opcode_00FF(Chip8 *chip8, const Instruction *ins) {
+    // Switch to the 128x64 mode. The screen is cleared.
+    setHires(&chip8->display, 1);
+
+    chip8->pc += 2;
+}
+
+// Fx30 - LD HF, Vx
+void opcode_Fx30(Chip8 *chip8, const Instruction *ins) {
+    // Set I = location of the 8x10 sprite for digit Vx.
+    uint8_t x = ins->x;
+    chip8->I = BIG_FONT_ADDRESS + (chip8->V[x] & 0xF) * 10;
+
+    chip8->pc += 2;
+}
+
+// Fx75 - LD R, Vx
+void opcode_Fx75(Chip8 *chip8, const Instruction *ins) {
+    // Store V0 through Vx in the user flags.
+    uint8_t x = ins->x;
+    memcpy(chip8->userFlags, chip8->V, x + 1);
+
+    chip8->pc += 2;
+}
+
+// Fx85 - LD Vx, R
+void opcode_Fx85(Chip8 *chip8, const Instruction *ins) {
+    // Read V0 through Vx from the user flags.
+    uint8_t x = ins->x;
+    memcpy(chip8->V, chip8->userFlags, x + 1);
+
+    chip8->pc += 2;
+}
+
+// XO-CHIP additions
+
+// 00Dn - SCU nibble
+void opcode_00Dn(Chip8 *chip8, const Instruction *ins) {
+    // Scroll the display up n pixels.
+    scrollDisplayUp(&chip8->display, ins->n);
+
+    chip8->pc += 2;
+}
+
+// 5xy2 - LD [I], Vx-Vy
+void opcode_5xy2(Chip8 *chip8, const Instruction *ins) {
+    // Store Vx through Vy (in either order) in memory starting at location I. I is unchanged.
+    int x = ins->x;
+    int y = ins->y;
+    int step = x <= y ? 1 : -1;
+    int count = abs(y - x) + 1;
+    for (int i = 0; i < count; ++i) {
+        chip8->memory[(uint16_t)(chip8->I + i)] = chip8->V[x + i * step];
+    }
+    invalidateDecoded(chip8, chip8->I, count);
+
+    chip8->pc += 2;
+}
+
+// 5xy3 - LD Vx-Vy, [I]
+void opcode_5xy3(Chip8 *chip8, const Instruction *ins) {
+    // Read Vx through Vy (in either order) from memory starting at location I. I is unchanged.
+    int x = ins->x;
+    int y = ins->y;
+    int step = x <= y ? 1 : -1;
+    int count = abs(y - x) + 1;
+    for (int i = 0; i < count; ++i) {
+        chip8->V[x + i * step] = chip8->memory[(uint16_t)(chip8->I + i)];
     }
 
     chip8->pc += 2;
-}
\ No newline at end of file
+}
+
+// F000 nnnn - LD I, long addr
+void opcode_F000(Chip8 *chip8, const Instruction *ins) {
+    // Set I = the 16-bit address in the two bytes after this instruction.
+    uint16_t next = chip8->pc + 2;
+    chip8->I = chip8->memory[next] << 8 | chip8->memory[(uint16_t)(next + 1)];
+
+    chip8->pc += 4;
+}
+
+// Fn01 - PLANE n
+void opcode_Fn01(Chip8 *chip8, const Instruction *ins) {
+    // Select the bitplanes that draws, scrolls and clears act on.
+    chip8->display.planeMask = ins->x & 0x3;
+
+    chip8->pc += 2;
+}
+
+// F002 - AUDIO
+void opcode_F002(Chip8 *chip8, const Instruction *ins) {
+    // Load the 16-byte audio pattern from memory starting at location I.
+    for (int i = 0; i < 16; ++i) {
+        chip8->audioPattern[i] = chip8->memory[(uint16_t)(chip8->I + i)];
+    }
+
+    chip8->pc += 2;
+}
+
+// Fx3A - PITCH Vx
+void opcode_Fx3A(Chip8 *chip8, const Instruction *ins) {
+    // Set the audio pattern playback rate to 4000 * 2^((Vx - 64) / 48) samples a second.
+    chip8->pitch = chip8->V[ins->x];
+
+    chip8->pc += 2;
+}
+
+// Moves pc past the instruction after the one at pc, which is 4 bytes long if it's F000
+static inline void skipNext(Chip8 *chip8) {
+    uint16_t next = chip8->pc + 2;
+    int longLoad = chip8->memory[next] == 0xF0 && chip8->memory[(uint16_t)(next + 1)] == 0x00;
+    chip8->pc += longLoad ? 6 : 4;
+}
+
+#define DEFINE_XOCHIP_SKIP(opcode, condition) \
+    void opcode_##opcode##_xochip(Chip8 *chip8, const Instruction *ins) { \
+        if (condition) { \
+            skipNext(chip8); \
+        } else { \
+            chip8->pc += 2; \
+        } \
+    }
+
+DEFINE_XOCHIP_SKIP(3xkk, chip8->V[ins->x] == ins->kk)
+DEFINE_XOCHIP_SKIP(4xkk, chip8->V[ins->x] != ins->kk)
+DEFINE_XOCHIP_SKIP(5xy0, chip8->V[ins->x] == chip8->V[ins->y])
+DEFINE_XOCHIP_SKIP(9xy0, chip8->V[ins->x] != chip8->V[ins->y])
+DEFINE_XOCHIP_SKIP(Ex9E, isKeyPressed(chip8, chip8->V[ins->x]))
+DEFINE_XOCHIP_SKIP(ExA1, !isKeyPressed(chip8, chip8->V[ins->x]))
+
+// Quirk profile handlers (see QuirkProfile in Chip8.h)
+//
+// Each handler below is one of these templates instantiated with its profile's quirks as
+// a constant. The quirk tests fold away, so every profile runs its own straight-line
+// copy, as if it had been written out by hand.
+#define QUIRK_VF_RESET   0x01 // 8xy1/8xy2/8xy3 clear VF
+#define QUIRK_SHIFT_VY   0x02 // 8xy6/8xyE shift Vy into Vx instead of shifting Vx
+#define QUIRK_MEMORY_I   0x04 // Fx55/Fx65 leave I one past the last register
+#define QUIRK_MEMORY_I_X 0x08 // Fx55/Fx65 add x to I (one short, as CHIP-48 did)
+#define QUIRK_JUMP_VX    0x10 // Bxnn jumps to xnn + Vx instead of nnn + V0
+#define QUIRK_CLIP       0x20 // sprites are clipped at the right and bottom edges
+#define QUIRK_WIDE       0x40 // Dxy0 draws a 16x16 sprite
+
+#define QUIRKS_OF_VIP    (QUIRK_VF_RESET | QUIRK_SHIFT_VY | QUIRK_MEMORY_I | QUIRK_CLIP)
+#define QUIRKS_OF_CHIP48 (QUIRK_MEMORY_I_X | QUIRK_JUMP_VX | QUIRK_CLIP)
+#define QUIRKS_OF_SCHIP  (QUIRK_JUMP_VX | QUIRK_CLIP | QUIRK_WIDE)
+#define QUIRKS_OF_XOCHIP (QUIRK_SHIFT_VY | QUIRK_MEMORY_I | QUIRK_WIDE)
+
+#define QUIRK_TEMPLATE static inline __attribute__((always_inline))
+
+// 8xy1, 8xy2, 8xy3
+QUIRK_TEMPLATE void logicTemplate(Chip8 *chip8, const Instruction *ins, int operation, unsigned quirks) {
+    uint8_t *vx = &chip8->V[ins->x];
+    uint8_t vy = chip8->V[ins->y];
+    if (operation == 0x1) {
+        *vx |= vy;
+    } else if (operation == 0x2) {
+        *vx &= vy;
+    } else {
+        *vx ^= vy;
+    }
+    if (quirks & QUIRK_VF_RESET) {
+        chip8->V[0xF] = 0;
+    }
+
+    chip8->pc += 2;
+}
+
+// 8xy4, 8xy5, 8xy7. The flag is a real carry / NOT borrow, and is written after the
+// result so it wins when x is F.
+QUIRK_TEMPLATE void arithmeticTemplate(Chip8 *chip8, const Instruction *ins, int operation) {
+    uint8_t vx = chip8->V[ins->x];
+    uint8_t vy = chip8->V[ins->y];
+    uint8_t flag;
+    if (operation == 0x4) {
+        chip8->V[ins->x] = vx + vy;
+        flag = vx + vy > 255;
+    } else if (operation == 0x5) {
+        chip8->V[ins->x] = vx - vy;
+        flag = vx >= vy;
+    } else {
+        chip8->V[ins->x] = vy - vx;
+        flag = vy >= vx;
+    }
+    chip8->V[0xF] = flag;
+
+    chip8->pc += 2;
+}
+
+// 8xy6, 8xyE. VF gets the bit shifted out
+QUIRK_TEMPLATE void shiftTemplate(Chip8 *chip8, const Instruction *ins, int left, unsigned quirks) {
+    uint8_t source = (quirks & QUIRK_SHIFT_VY) ? chip8->V[ins->y] : chip8->V[ins->x];
+    if (left) {
+        chip8->V[ins->x] = source << 1;
+        chip8->V[0xF] = source >> 7;
+    } else {
+        chip8->V[ins->x] = source >> 1;
+        chip8->V[0xF] = source & 0x1;
+    }
+
+    chip8->pc += 2;
+}
+
+// Bnnn
+QUIRK_TEMPLATE void jumpTemplate(Chip8 *chip8, const Instruction *ins, unsigned quirks) {
+    // x is the top nibble of nnn, so Bxnn still jumps to nnn, just plus a different register
+    uint8_t offset = (quirks & QUIRK_JUMP_VX) ? chip8->V[ins->x] : chip8->V[0x0];
+    chip8->pc = ins->nnn + offset;
+}
+
+// Dxyn
+QUIRK_TEMPLATE void drawTemplate(Chip8 *chip8, const Instruction *ins, unsigned quirks) {
+    uint8_t buffer[MAX_SPRITE_BYTES];
+    int wide = (quirks & QUIRK_WIDE) && ins->n == 0;
+    const uint8_t *sprite = spriteAt(chip8, (wide ? 32 : ins->n) * DISPLAY_PLANES, buffer);
+    uint8_t x = chip8->V[ins->x];
+    uint8_t y = chip8->V[ins->y];
+    if (wide) {
+        if (quirks & QUIRK_CLIP) {
+            chip8->V[0xF] = drawWideSpriteClipped(&chip8->display, sprite, x, y);
+        } else {
+            chip8->V[0xF] = drawWideSprite(&chip8->display, sprite, x, y);
+        }
+    } else if (quirks & QUIRK_CLIP) {
+        chip8->V[0xF] = drawSpriteClipped(&chip8->display, sprite, ins->n, x, y);
+    } else {
+        chip8->V[0xF] = drawSprite(&chip8->display, sprite, ins->n, x, y);
+    }
+
+    chip8->pc += 2;
+}
+
+// What Fx55 and Fx65 leave in I
+QUIRK_TEMPLATE void advanceI(Chip8 *chip8, uint8_t x, unsigned quirks) {
+    if (quirks & QUIRK_MEMORY_I) {
+        chip8->I += x + 1;
+    } else if (quirks & QUIRK_MEMORY_I_X) {
+        chip8->I += x;
+    }
+}
+
+// Fx55
+QUIRK_TEMPLATE void storeTemplate(Chip8 *chip8, const Instruction *ins, unsigned quirks) {
+    uint8_t x = ins->x;
+    for (int i = 0; i <= x; ++i) {
+        chip8->memory[(uint16_t)(chip8->I + i)] = chip8->V[i];
+    }
+    invalidateDecoded(chip8, chip8->I, x + 1);
+    advanceI(chip8, x, quirks);
+
+    chip8->pc += 2;
+}
+
+// Fx65
+QUIRK_TEMPLATE void loadTemplate(Chip8 *chip8, const Instruction *ins, unsigned quirks) {
+    uint8_t x = ins->x;
+    for (int i = 0; i <= x; ++i) {
+        chip8->V[i] = chip8->memory[(uint16_t)(chip8->I + i)];
+    }
+    advanceI(chip8, x, quirks);
+
+    chip8->pc += 2;
+}
+
+#define DEFINE_QUIRK_HANDLERS(profile, quirks) \
+    void opcode_8xy1_##profile(Chip8 *chip8, const Instruction *ins) { logicTemplate(chip8, ins, 0x1, quirks); } \
+    void opcode_8xy2_##profile(Chip8 *chip8, const Instruction *ins) { logicTemplate(chip8, ins, 0x2, quirks); } \
+    void opcode_8xy3_##profile(Chip8 *chip8, const Instruction *ins) { logicTemplate(chip8, ins, 0x3, quirks); } \
+    void opcode_8xy4_##profile(Chip8 *chip8, const Instruction *ins) { arithmeticTemplate(chip8, ins, 0x4); } \
+    void opcode_8xy5_##profile(Chip8 *chip8, const Instruction *ins) { arithmeticTemplate(chip8, ins, 0x5); } \
+    void opcode_8xy6_##profile(Chip8 *chip8, const Instruction *ins) { shiftTemplate(chip8, ins, 0, quirks); } \
+    void opcode_8xy7_##profile(Chip8 *chip8, const Instruction *ins) { arithmeticTemplate(chip8, ins, 0x7); } \
+    void opcode_8xyE_##profile(Chip8 *chip8, const Instruction *ins) { shiftTemplate(chip8, ins, 1, quirks); } \
+    void opcode_Bnnn_##profile(Chip8 *chip8, const Instruction *ins) { jumpTemplate(chip8, ins, quirks); } \
+    void opcode_Dxyn_##profile(Chip8 *chip8, const Instruction *ins) { drawTemplate(chip8, ins, quirks); } \
+    void opcode_Fx55_##profile(Chip8 *chip8, const Instruction *ins) { storeTemplate(chip8, ins, quirks); } \
+    void opcode_Fx65_##profile(Chip8 *chip8, const Instruction *ins) { loadTemplate(chip8, ins, quirks); }
+
+DEFINE_QUIRK_HANDLERS(vip, QUIRKS_OF_VIP)
+DEFINE_QUIRK_HANDLERS(chip48, QUIRKS_OF_CHIP48)
+DEFINE_QUIRK_HANDLERS(schip, QUIRKS_OF_SCHIP)
+DEFINE_QUIRK_HANDLERS(xochip, QUIRKS_OF_XOCHIP)
+
+#define QUIRK_HANDLER(opcode, profile) opcode_##opcode##profile,
+const QuirkHandlers quirkHandlers[QUIRK_PROFILES] = {
+    [QUIRKS_DEFAULT] = {QUIRK_OPCODES(QUIRK_HANDLER, )},
+    [QUIRKS_VIP] = {QUIRK_OPCODES(QUIRK_HANDLER, _vip)},
+    [QUIRKS_CHIP48] = {QUIRK_OPCODES(QUIRK_HANDLER, _chip48)},
+    [QUIRKS_SCHIP] = {QUIRK_OPCODES(QUIRK_HANDLER, _schip)},
+    [QUIRKS_XOCHIP] = {QUIRK_OPCODES(QUIRK_HANDLER, _xochip)},
+};
+
+// Every handler that runs an opcode in place of a default one, and that default
+typedef struct {
+    OpcodeHandler handler;
+    OpcodeHandler base;
+} HandlerVariant;
+
+#define QUIRK_HANDLER_VARIANT(opcode, profile) {opcode_##opcode##_##profile, opcode_##opcode},
+
+static const HandlerVariant handlerVariants[] = {
+    QUIRK_OPCODES(QUIRK_HANDLER_VARIANT, vip)
+    QUIRK_OPCODES(QUIRK_HANDLER_VARIANT, chip48)
+    QUIRK_OPCODES(QUIRK_HANDLER_VARIANT, schip)
+    QUIRK_OPCODES(QUIRK_HANDLER_VARIANT, xochip)
+    {opcode_3xkk_xochip, opcode_3xkk}, {opcode_4xkk_xochip, opcode_4xkk},
+    {opcode_5xy0_xochip, opcode_5xy0}, {opcode_9xy0_xochip, opcode_9xy0},
+    {opcode_Ex9E_xochip, opcode_Ex9E}, {opcode_ExA1_xochip, opcode_ExA1},
+};
+
+int isHandlerFor(OpcodeHandler handler, OpcodeHandler base) {
+    if (handler == base) {
+        return 1;
+    }
+    for (size_t i = 0; i < sizeof(handlerVariants) / sizeof(handlerVariants[0]); ++i) {
+        if (handlerVariants[i].handler == handler && handlerVariants[i].base == base) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    OpcodeHandler handler;
+    const char *name;
+} HandlerName;
+
+#define QUIRK_HANDLER_NAME(opcode, profile) {opcode_##opcode##_##profile, "opcode_" #opcode "_" #profile},
+
+
+static const HandlerName handlerNames[] = {
+    {opcode_00E0, "opcode_00E0"}, {opcode_00EE, "opcode_00EE"}, {opcode_1nnn, "opcode_1nnn"},
+    {opcode_2nnn, "opcode_2nnn"}, {opcode_3xkk, "opcode_3xkk"}, {opcode_4xkk, "opcode_4xkk"},
+    {opcode_5xy0, "opcode_5xy0"}, {opcode_6xnn, "opcode_6xnn"}, {opcode_7xkk, "opcode_7xkk"},
+    {opcode_8xy0, "opcode_8xy0"}, {opcode_8xy1, "opcode_8xy1"}, {opcode_8xy2, "opcode_8xy2"},
+    {opcode_8xy3, "opcode_8xy3"}, {opcode_8xy4, "opcode_8xy4"}, {opcode_8xy5, "opcode_8xy5"},
+    {opcode_8xy6, "opcode_8xy6"}, {opcode_8xy7, "opcode_8xy7"}, {opcode_8xyE, "opcode_8xyE"},
+    {opcode_9xy0, "opcode_9xy0"}, {opcode_Annn, "opcode_Annn"}, {opcode_Bnnn, "opcode_Bnnn"},
+    {opcode_Cxkk, "opcode_Cxkk"}, {opcode_Dxyn, "opcode_Dxyn"}, {opcode_Ex9E, "opcode_Ex9E"},
+    {opcode_ExA1, "opcode_ExA1"}, {opcode_Fx07, "opcode_Fx07"}, {opcode_Fx0A, "opcode_Fx0A"},
+    {opcode_Fx15, "opcode_Fx15"}, {opcode_Fx18, "opcode_Fx18"}, {opcode_Fx1E, "opcode_Fx1E"},
+    {opcode_Fx29, "opcode_Fx29"}, {opcode_Fx33, "opcode_Fx33"}, {opcode_Fx55, "opcode_Fx55"},
+    {opcode_Fx65, "opcode_Fx65"}, {opcode_unknown, "opcode_unknown"},
+    QUIRK_OPCODES(QUIRK_HANDLER_NAME, vip)
+    QUIRK_OPCODES(QUIRK_HANDLER_NAME, chip48)
+    QUIRK_OPCODES(QUIRK_HANDLER_NAME, schip)
+    QUIRK_OPCODES(QUIRK_HANDLER_NAME, xochip)
+    {opcode_00Cn, "opcode_00Cn"}, {opcode_00FB, "opcode_00FB"}, {opcode_00FC, "opcode_00FC"},
+    {opcode_00FD, "opcode_00FD"}, {opcode_00FE, "opcode_00FE"}, {opcode_00FF, "opcode_00FF"},
+    {opcode_Fx30, "opcode_Fx30"}, {opcode_Fx75, "opcode_Fx75"}, {opcode_Fx85, "opcode_Fx85"},
+    {opcode_00Dn, "opcode_00Dn"}, {opcode_5xy2, "opcode_5xy2"}, {opcode_5xy3, "opcode_5xy3"},
+    {opcode_F000, "opcode_F000"}, {opcode_Fn01, "opcode_Fn01"}, {opcode_F002, "opcode_F002"},
+    {opcode_Fx3A, "opcode_Fx3A"},
+    {opcode_3xkk_xochip, "opcode_3xkk_xochip"}, {opcode_4xkk_xochip, "opcode_4xkk_xochip"},
+    {opcode_5xy0_xochip, "opcode_5xy0_xochip"}, {opcode_9xy0_xochip, "opcode_9xy0_xochip"},
+    {opcode_Ex9E_xochip, "opcode_Ex9E_xochip"}, {opcode_ExA1_xochip, "opcode_ExA1_xochip"},
+};
+
+const char *handlerName(OpcodeHandler handler) {
+    for (size_t i = 0; i < sizeof(handlerNames) / sizeof(handlerNames[0]); ++i) {
+        if (handlerNames[i].handler == handler) {
+            return handlerNames[i].name;
+        }
+    }
+    return "opcode_unknown";
+}
@@ -1,43 +1,106 @@
 #ifndef OPCODES_H
 #define OPCODES_H
 
-void opcode_00E0(Chip8 *chip8);
-void opcode_00EE(Chip8 *chip8);
-void opcode_1nnn(Chip8 *chip8);
-void opcode_2nnn(Chip8 *chip8);
-void opcode_3xkk(Chip8 *chip8);
-void opcode_4xkk(Chip8 *chip8);
-void opcode_5xy0(Chip8 *chip8);
-void opcode_6xnn(Chip8 *chip8);
-void opcode_7xkk(Chip8 *chip8);
-
-void opcode_8xy0(Chip8 *chip8);
-void opcode_8xy1(Chip8 *chip8);
-void opcode_8xy2(Chip8 *chip8);
-void opcode_8xy3(Chip8 *chip8);
-void opcode_8xy4(Chip8 *chip8);
-void opcode_8xy5(Chip8 *chip8);
-void opcode_8xy6(Chip8 *chip8);
-void opcode_8xy7(Chip8 *chip8);
-void opcode_8xyE(Chip8 *chip8);
-
-void opcode_9xy0(Chip8 *chip8);
-void opcode_Annn(Chip8 *chip8);
-void opcode_Bnnn(Chip8 *chip8);
-void opcode_Cxkk(Chip8 *chip8);
-void opcode_Dxyn(Chip8 *chip8);
-
-void opcode_Ex9E(Chip8 *chip8);
-void opcode_ExA1(Chip8 *chip8);
-
-void opcode_Fx07(Chip8 *chip8);
-void opcode_Fx0A(Chip8 *chip8);
-void opcode_Fx15(Chip8 *chip8);
-void opcode_Fx18(Chip8 *chip8);
-void opcode_Fx1E(Chip8 *chip8);
-void opcode_Fx29(Chip8 *chip8);
-void opcode_Fx33(Chip8 *chip8);
-void opcode_Fx55(Chip8 *chip8);
-void opcode_Fx65(Chip8 *chip8);
+#include "Chip8.h"
+
+void opcode_00E0(Chip8 *chip8, const Instruction *ins);
+void opcode_00EE(Chip8 *chip8, const Instruction *ins);
+void opcode_1nnn(Chip8 *chip8, const Instruction *ins);
+void opcode_2nnn(Chip8 *chip8, const Instruction *ins);
+void opcode_3xkk(Chip8 *chip8, const Instruction *ins);
+void opcode_4xkk(Chip8 *chip8, const Instruction *ins);
+void opcode_5xy0(Chip8 *chip8, const Instruction *ins);
+void opcode_6xnn(Chip8 *chip8, const Instruction *ins);
+void opcode_7xkk(Chip8 *chip8, const Instruction *ins);
+
+void opcode_8xy0(Chip8 *chip8, const Instruction *ins);
+void opcode_8xy1(Chip8 *chip8, const Instruction *ins);
+void opcode_8xy2(Chip8 *chip8, const Instruction *ins);
+void opcode_8xy3(Chip8 *chip8, const Instruction *ins);
+void opcode_8xy4(Chip8 *chip8, const Instruction *ins);
+void opcode_8xy5(Chip8 *chip8, const Instruction *ins);
+void opcode_8xy6(Chip8 *chip8, const Instruction *ins);
+void opcode_8xy7(Chip8 *chip8, const Instruction *ins);
+void opcode_8xyE(Chip8 *chip8, const Instruction *ins);
+
+void opcode_9xy0(Chip8 *chip8, const Instruction *ins);
+void opcode_Annn(Chip8 *chip8, const Instruction *ins);
+void opcode_Bnnn(Chip8 *chip8, const Instruction *ins);
+void opcode_Cxkk(Chip8 *chip8, const Instruction *ins);
+void opcode_Dxyn(Chip8 *chip8, const Instruction *ins);
+
+void opcode_Ex9E(Chip8 *chip8, const Instruction *ins);
+void opcode_ExA1(Chip8 *chip8, const Instruction *ins);
+
+void opcode_Fx07(Chip8 *chip8, const Instruction *ins);
+void opcode_Fx0A(Chip8 *chip8, const Instruction *ins);
+void opcode_Fx15(Chip8 *chip8, const Instruction *ins);
+void opcode_Fx18(Chip8 *chip8, const Instruction *ins);
+void opcode_Fx1E(Chip8 *chip8, const Instruction *ins);
+void opcode_Fx29(Chip8 *chip8, const Instruction *ins);
+void opcode_Fx33(Chip8 *chip8, const Instruction *ins);
+void opcode_Fx55(Chip8 *chip8, const Instruction *ins);
+void opcode_Fx65(Chip8 *chip8, const Instruction *ins);
+
+void opcode_unknown(Chip8 *chip8, const Instruction *ins);
+
+// SUPER-CHIP additions, decoded by the schip and xochip profiles
+void opcode_00Cn(Chip8 *chip8, const Instruction *ins);
+void opcode_00FB(Chip8 *chip8, const Instruction *ins);
+void opcode_00FC(Chip8 *chip8, const Instruction *ins);
+void opcode_00FD(Chip8 *chip8, const Instruction *ins);
+void opcode_00FE(Chip8 *chip8, const Instruction *ins);
+void opcode_00FF(Chip8 *chip8, const Instruction *ins);
+void opcode_Fx30(Chip8 *chip8, const Instruction *ins);
+void opcode_Fx75(Chip8 *chip8, const Instruction *ins);
+void opcode_Fx85(Chip8 *chip8, const Instruction *ins);
+
+// XO-CHIP additions, decoded by the xochip profile
+void opcode_00Dn(Chip8 *chip8, const Instruction *ins);
+void opcode_5xy2(Chip8 *chip8, const Instruction *ins);
+void opcode_5xy3(Chip8 *chip8, const Instruction *ins);
+void opcode_F000(Chip8 *chip8, const Instruction *ins);
+void opcode_Fn01(Chip8 *chip8, const Instruction *ins);
+void opcode_F002(Chip8 *chip8, const Instruction *ins);
+void opcode_Fx3A(Chip8 *chip8, const Instruction *ins);
+// F000 nnnn is four bytes long, so on XO-CHIP the skips step over it whole
+void opcode_3xkk_xochip(Chip8 *chip8, const Instruction *ins);
+void opcode_4xkk_xochip(Chip8 *chip8, const Instruction *ins);
+void opcode_5xy0_xochip(Chip8 *chip8, const Instruction *ins);
+void opcode_9xy0_xochip(Chip8 *chip8, const Instruction *ins);
+void opcode_Ex9E_xochip(Chip8 *chip8, const Instruction *ins);
+void opcode_ExA1_xochip(Chip8 *chip8, const Instruction *ins);
+
+// The opcodes whose behaviour depends on the quirk profile. X is applied to each one
+#define QUIRK_OPCODES(X, profile) \
+    X(8xy1, profile) X(8xy2, profile) X(8xy3, profile) X(8xy4, profile) \
+    X(8xy5, profile) X(8xy6, profile) X(8xy7, profile) X(8xyE, profile) \
+    X(Bnnn, profile) X(Dxyn, profile) X(Fx55, profile) X(Fx65, profile)
+
+// Every profile but QUIRKS_DEFAULT has its own instance of each of those handlers,
+// e.g. opcode_8xy6_vip. They also set VF the way the real interpreters did, which the
+// default handlers above don't always do.
+#define DECLARE_QUIRK_HANDLER(opcode, profile) \
+    void opcode_##opcode##_##profile(Chip8 *chip8, const Instruction *ins);
+QUIRK_OPCODES(DECLARE_QUIRK_HANDLER, vip)
+QUIRK_OPCODES(DECLARE_QUIRK_HANDLER, chip48)
+QUIRK_OPCODES(DECLARE_QUIRK_HANDLER, schip)
+QUIRK_OPCODES(DECLARE_QUIRK_HANDLER, xochip)
+
+// One profile's handlers for the opcodes in QUIRK_OPCODES
+#define QUIRK_HANDLER_FIELD(opcode, profile) OpcodeHandler opcode_##opcode;
+typedef struct {
+    QUIRK_OPCODES(QUIRK_HANDLER_FIELD, )
+} QuirkHandlers;
+
+// Indexed by QuirkProfile. The decoder picks handlers from here.
+extern const QuirkHandlers quirkHandlers[QUIRK_PROFILES];
+
+// Returns 1 if handler is some profile's handler for the same opcode as the default
+// handler base, e.g. opcode_Bnnn_schip or opcode_3xkk_xochip for opcode_3xkk.
+int isHandlerFor(OpcodeHandler handler, OpcodeHandler base);
+
+// The C name of a handler, e.g. "opcode_Dxyn". Used by the translator and the profiler.
+const char *handlerName(OpcodeHandler handler);
 
 #endif // OPCODES_H
\ No newline at end of file
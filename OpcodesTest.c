@@ -0,0 +1,98 @@
+// Runs the instructions that access memory through I with I at the top of memory.
+//
+// Usage: chip8opcodetest   (make test)
+// With 64 KB of memory and F000 nnnn, I can sit at 0xFFFE. Everything read or written
+// through it must wrap to address 0 rather than run into the registers that follow memory
+// in Chip8. Exits with 1 if anything differs.
+
+#include <stdio.h>
+
+#include "Chip8.h"
+#include "Decoder.h"
+
+#define TOP 0xFFFE
+
+static int failures = 0;
+
+static void check(int ok, const char *what, const char *profile) {
+    if (!ok) {
+        fprintf(stderr, "FAIL: %s (%s)\n", what, profile);
+        failures++;
+    }
+}
+
+// Runs one instruction from 0x200 with I = TOP
+static void run(Chip8 *chip8, uint16_t opcode) {
+    chip8->memory[0x200] = opcode >> 8;
+    chip8->memory[0x201] = opcode & 0xFF;
+    invalidateDecoded(chip8, 0x200, 2);
+    chip8->pc = 0x200;
+    chip8->I = TOP;
+    stepChip8(chip8);
+}
+
+// The registers past the ones an instruction uses, which an overrun would hit first
+static int sentinelsIntact(const Chip8 *chip8) {
+    for (int i = 4; i < 15; ++i) {
+        if (chip8->V[i] != 0xA0 + i) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void testProfile(QuirkProfile quirks, const char *profile) {
+    static Chip8 chip8;
+    initializeChip8(&chip8);
+    setQuirks(&chip8, quirks);
+    for (int i = 0; i < 16; ++i) {
+        chip8.V[i] = 0xA0 + i;
+    }
+
+    // Fx33: the BCD digits of 123 at 0xFFFE, 0xFFFF and 0
+    chip8.V[0] = 123;
+    run(&chip8, 0xF033);
+    check(chip8.memory[0xFFFE] == 1 && chip8.memory[0xFFFF] == 2 && chip8.memory[0] == 3,
+          "Fx33 digits", profile);
+    check(sentinelsIntact(&chip8) && chip8.pc == 0x202, "Fx33 overran memory", profile);
+
+    // Fx55 of V0..V3 to 0xFFFE, 0xFFFF, 0 and 1
+    for (int i = 0; i < 4; ++i) {
+        chip8.V[i] = 0x11 * (i + 1);
+    }
+    run(&chip8, 0xF355);
+    check(chip8.memory[0xFFFE] == 0x11 && chip8.memory[0xFFFF] == 0x22 && chip8.memory[0] == 0x33
+              && chip8.memory[1] == 0x44, "Fx55 stored", profile);
+    check(sentinelsIntact(&chip8) && chip8.pc == 0x202, "Fx55 overran memory", profile);
+
+    // Fx65 reads them back
+    for (int i = 0; i < 4; ++i) {
+        chip8.V[i] = 0;
+    }
+    run(&chip8, 0xF365);
+    check(chip8.V[0] == 0x11 && chip8.V[1] == 0x22 && chip8.V[2] == 0x33 && chip8.V[3] == 0x44,
+          "Fx65 loaded", profile);
+    check(sentinelsIntact(&chip8), "Fx65 overran memory", profile);
+
+    // Dxyn: a 4-row sprite whose last two rows come from addresses 0 and 1
+    chip8.V[0] = 0;
+    chip8.V[1] = 0;
+    run(&chip8, 0xD014);
+    static const uint8_t rows[4] = {0x11, 0x22, 0x33, 0x44};
+    for (int row = 0; row < 4; ++row) {
+        check(chip8.display.planes[0][row] == (DisplayRow)rows[row] << (DISPLAY_WIDTH - 8),
+              "Dxyn rows", profile);
+    }
+    check(sentinelsIntact(&chip8), "Dxyn changed registers", profile);
+}
+
+int main(void) {
+    testProfile(QUIRKS_DEFAULT, "default");
+    testProfile(QUIRKS_SCHIP, "schip");
+    testProfile(QUIRKS_XOCHIP, "xochip");
+
+    if (failures == 0) {
+        printf("Opcode memory wrapping passed\n");
+    }
+    return failures != 0;
+}
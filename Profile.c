@@ -0,0 +1,162 @@
+#include "Profile.h"
+
+#ifdef CHIP8_PROFILE
+
+#include <stdlib.h>
+
+#include "Chip8.h"
+#include "Decoder.h"
+#include "Opcodes.h"
+
+#define HOT_ADDRESSES 32
+#define HEATMAP_WIDTH 64
+
+// counted by the full opcode so nothing has to be looked up while running.
+// Grouped by handler when the report is written.
+static uint64_t opcodeCounts[0x10000];
+static uint64_t opcodeTicks[0x10000];
+static uint64_t addressCounts[MEMORY_SIZE];
+static uint64_t addressTicks[MEMORY_SIZE];
+// last opcode seen at each address
+static uint16_t addressOpcodes[MEMORY_SIZE];
+// bit p is set once anything ran under QuirkProfile p, so opcodes are named as decoded
+static unsigned profiledQuirks;
+
+void profileRecord(uint16_t pc, uint16_t opcode, uint8_t quirks, uint64_t ticks) {
+    profiledQuirks |= 1u << quirks;
+    opcodeCounts[opcode]++;
+    opcodeTicks[opcode] += ticks;
+    pc %= MEMORY_SIZE;
+    addressCounts[pc]++;
+    addressTicks[pc] += ticks;
+    addressOpcodes[pc] = opcode;
+}
+
+typedef struct {
+    const char *name;
+    uint64_t count;
+    uint64_t ticks;
+} HandlerProfile;
+
+static int byTicks(const void *a, const void *b) {
+    const HandlerProfile *x = a;
+    const HandlerProfile *y = b;
+    return (x->ticks < y->ticks) - (x->ticks > y->ticks);
+}
+
+static int byAddressCount(const void *a, const void *b) {
+    uint64_t x = addressCounts[*(const uint16_t *)a];
+    uint64_t y = addressCounts[*(const uint16_t *)b];
+    return (x < y) - (x > y);
+}
+
+// The handler that ran opcode. Counts are kept per opcode, not per profile, so if programs
+// ran under more than one profile this names XO-CHIP's, which decodes every extension
+static const char *nameOf(uint16_t opcode) {
+    QuirkProfile quirks = QUIRKS_XOCHIP;
+    for (int profile = 0; profile < QUIRK_PROFILES; ++profile) {
+        if (profiledQuirks == 1u << profile) {
+            quirks = profile;
+        }
+    }
+    Instruction ins;
+    decodeInstruction(&ins, opcode, quirks);
+    return handlerName(ins.handler);
+}
+
+void writeProfileReport(FILE *out) {
+    uint64_t totalCount = 0;
+    uint64_t totalTicks = 0;
+    for (int opcode = 0; opcode < 0x10000; ++opcode) {
+        totalCount += opcodeCounts[opcode];
+        totalTicks += opcodeTicks[opcode];
+    }
+    if (totalCount == 0) {
+        return;
+    }
+
+    // per handler
+    HandlerProfile handlers[64];
+    int handlerCount = 0;
+    for (int opcode = 0; opcode < 0x10000; ++opcode) {
+        if (opcodeCounts[opcode] == 0) {
+            continue;
+        }
+        const char *name = nameOf(opcode);
+        int h = 0;
+        while (h < handlerCount && handlers[h].name != name) {
+            h++;
+        }
+        if (h == handlerCount) {
+            handlers[handlerCount++] = (HandlerProfile){name, 0, 0};
+        }
+        handlers[h].count += opcodeCounts[opcode];
+        handlers[h].ticks += opcodeTicks[opcode];
+    }
+    qsort(handlers, handlerCount, sizeof(HandlerProfile), byTicks);
+
+    fprintf(out, "Instructions: %llu  Ticks: %llu  (%.1f ticks/instruction)\n\n",
+            (unsigned long long)totalCount, (unsigned long long)totalTicks, (double)totalTicks / totalCount);
+    fprintf(out, "%-20s %14s %7s %16s %7s %10s\n", "handler", "count", "count%", "ticks", "time%", "ticks/op");
+    for (int h = 0; h < handlerCount; ++h) {
+        fprintf(out, "%-20s %14llu %6.2f%% %16llu %6.2f%% %10.1f\n", handlers[h].name,
+                (unsigned long long)handlers[h].count, 100.0 * handlers[h].count / totalCount,
+                (unsigned long long)handlers[h].ticks, 100.0 * handlers[h].ticks / totalTicks,
+                (double)handlers[h].ticks / handlers[h].count);
+    }
+
+    // hottest addresses
+    static uint16_t addresses[MEMORY_SIZE];
+    for (int pc = 0; pc < MEMORY_SIZE; ++pc) {
+        addresses[pc] = pc;
+    }
+    qsort(addresses, MEMORY_SIZE, sizeof(uint16_t), byAddressCount);
+    fprintf(out, "\n%-7s %6s %-20s %14s %7s %7s\n", "address", "opcode", "handler", "count", "count%", "time%");
+    for (int i = 0; i < HOT_ADDRESSES && addressCounts[addresses[i]] > 0; ++i) {
+        uint16_t pc = addresses[i];
+        fprintf(out, "0x%03X   %04X   %-20s %14llu %6.2f%% %6.2f%%\n", pc, addressOpcodes[pc],
+                nameOf(addressOpcodes[pc]), (unsigned long long)addressCounts[pc],
+                100.0 * addressCounts[pc] / totalCount, 100.0 * addressTicks[pc] / totalTicks);
+    }
+
+    // One character per address, HEATMAP_WIDTH per row. Log scale relative to the hottest address,
+    // since a few loops usually dominate.
+    static const char shades[] = " .:-=+*#%@";
+    uint64_t hottest = addressCounts[addresses[0]];
+    // stop after the last row anything ran in. Most programs stay in the first 4KB
+    int end = MEMORY_SIZE;
+    while (end > 0 && addressCounts[end - 1] == 0) {
+        end--;
+    }
+    fprintf(out, "\nHeatmap (one character per address, ' ' never executed to '@' hottest)\n");
+    for (int row = 0; row < end; row += HEATMAP_WIDTH) {
+        fprintf(out, "0x%03X |", row);
+        for (int pc = row; pc < row + HEATMAP_WIDTH; ++pc) {
+            int shade = 0;
+            if (addressCounts[pc] > 0) {
+                // 1 .. 9 over log2 of the count
+                int bits = 64 - __builtin_clzll(addressCounts[pc]);
+                int maxBits = 64 - __builtin_clzll(hottest);
+                shade = 1 + (bits * 8) / maxBits;
+                if (shade > 9) {
+                    shade = 9;
+                }
+            }
+            fputc(shades[shade], out);
+        }
+        fprintf(out, "|\n");
+    }
+}
+
+void saveProfileReport(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Failed to open %s for writing\n", path);
+        return;
+    }
+    writeProfileReport(out);
+    fclose(out);
+    fprintf(stderr, "Profile written to %s\n", path);
+}
+
+#endif // CHIP8_PROFILE
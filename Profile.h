@@ -0,0 +1,54 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Execution profiler. Only built with -DCHIP8_PROFILE (make PROFILE=1); otherwise the
+// hooks below compile to nothing.
+//
+// Every interpreted instruction is counted and timed, by opcode and by address.
+// The report sums them per handler in Opcodes.c, lists the hottest addresses and draws
+// a heatmap of memory up to the last address anything ran at. The counters are process wide and not
+// thread safe, so profiled builds of chip8farm run one worker. Profiled builds always interpret,
+// since compiled blocks can't be counted per instruction.
+
+#ifdef CHIP8_PROFILE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+// time stamp counter ticks
+static inline uint64_t profileTicks(void) {
+    return __rdtsc();
+}
+#else
+#include <time.h>
+// nanoseconds
+static inline uint64_t profileTicks(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+#endif
+
+// Adds one execution of opcode at address pc, decoded under the quirks profile, that took ticks
+void profileRecord(uint16_t pc, uint16_t opcode, uint8_t quirks, uint64_t ticks);
+
+// Writes the report. Does nothing if no instructions were recorded.
+void writeProfileReport(FILE *out);
+
+// Writes the report to the file at path, for the tools to call on exit, and says so on stderr
+void saveProfileReport(const char *path);
+
+// Wrap an instruction: PROFILE_START(); <execute>; PROFILE_END(pc, opcode, quirks);
+#define PROFILE_START() uint64_t profileStart = profileTicks()
+#define PROFILE_END(pc, opcode, quirks) profileRecord((pc), (opcode), (quirks), profileTicks() - profileStart)
+
+#else
+
+#define PROFILE_START()
+#define PROFILE_END(pc, opcode, quirks)
+
+#endif // CHIP8_PROFILE
+
+#endif // PROFILE_H
@@ -2,68 +2,567 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include <time.h>
-// sound
-#include <math.h>
 
 //sudo apt-get install libsdl2-dev
 #include <SDL2/SDL.h>
 
 #include "Chip8.h"
-#include "Display.h"
-#include "Opcodes.h"
 #include "Keypad.h"
+#include "Jit.h"
+#include "Renderer.h"
+#include "Input.h"
+#include "Scheduler.h"
+#include "SaveState.h"
+#include "Rewind.h"
+#include "Profile.h"
+#include "FrameStats.h"
+#include "Audio.h"
+#include "InputQueue.h"
+#include "TripleBuffer.h"
+#include "Timing.h"
+#include "Tuner.h"
+#include "RomDatabase.h"
 
-void my_audio_callback(void* userdata, Uint8* stream, int length)
-{
-    Sint16* buffer = (Sint16*) stream;
-    int sample_count = length / 2;
+// per-ROM settings, read at startup if it exists (see RomDatabase.h)
+#define DEFAULT_ROM_DATABASE "roms.cfg"
 
-    for (int i = 0; i < sample_count; ++i)
-    {
-        //buffer[i] = rand() % 30000; // white noise
-        //buffer[i] = 4000 * cos(2 * 3.14 * 440 * i / 44100); // sine wave
-        buffer[i] = 2000 * (i % 128 < 64 ? 1 : -1); // Simple square wave
-        // amplitude * (i % period < period / 2 ? 1 : -1)
+// frames of history kept for rewinding (ten minutes), and how often a keyframe is stored
+#define REWIND_FRAMES (60 * 60 * 10)
+#define REWIND_KEYFRAME_INTERVAL 60
+
+// F5 saves the machine to statePath and F9 loads it back. Holding Backspace rewinds.
+static char statePath[4096];
+static bool rewinding = false;
+// F3 toggles the frame time overlay
+static FrameStats frameStats;
+static const char *windowTitle = "CHIP-8 Emulator";
+// --timing vip charges instructions their COSMAC VIP cycles instead of running a fixed count
+static bool vipTiming = false;
+
+// Runs up to budget instructions, or budget machine cycles with VIP timing
+static int runBudget(Chip8 *chip8, int budget) {
+    return vipTiming ? runChip8Cycles(chip8, budget) : runChip8(chip8, budget);
+}
+
+// The end of an emulated frame. The timers tick, at the VIP's display interrupt with VIP timing
+static void endFrame(Chip8 *chip8) {
+    if (vipTiming) {
+        endVipFrame(chip8);
+    } else {
+        updateTimers(chip8);
     }
 }
 
-int main(int argc, char **argv) {
-    Chip8 chip8;
-    initializeChip8(&chip8);
+// Hands the sound timer, and under XO-CHIP the ROM's audio pattern and pitch, to the audio callback
+static void updateAudio(Audio *audio, const Chip8 *chip8) {
+    setAudioPattern(audio, chip8->quirks == QUIRKS_XOCHIP ? chip8->audioPattern : NULL, chip8->pitch);
+    setAudioGate(audio, chip8->sound_timer > 0);
+}
+
+// Prints the rate --auto-ipf settled on. The database line that pins it goes to stdout on
+// its own, so it can be appended straight to the database
+static void reportTunedRate(const Tuner *tuner, const char *romPath, uint64_t romHash,
+                            const char *databasePath) {
+    int rate = tunedRate(tuner);
+    fprintf(stderr, "Tuned to %d instructions per frame (last %d). To pin it, add this line to %s:\n",
+            rate, tuner->instructionsPerFrame, databasePath);
+    const char *name = strrchr(romPath, '/');
+    printf("%016llx %d %s\n", (unsigned long long)romHash, rate, name != NULL ? name + 1 : romPath);
+}
+
+// F5 and F9
+static void saveState(Chip8 *chip8) {
+    Chip8State state;
+    saveChip8State(chip8, &state);
+    if (writeChip8State(&state, statePath) == 0) {
+        fprintf(stderr, "Saved state to %s\n", statePath);
+    } else {
+        fprintf(stderr, "Failed to save state to %s\n", statePath);
+    }
+}
+
+static void loadState(Chip8 *chip8) {
+    Chip8State state;
+    if (readChip8State(&state, statePath) == 0) {
+        loadChip8State(chip8, &state);
+        fprintf(stderr, "Loaded state from %s\n", statePath);
+    } else {
+        fprintf(stderr, "No usable save state at %s\n", statePath);
+    }
+}
+
+// Saves the machine into real, then runs frames ahead of it with the keys as they are now.
+// The caller shows the result and loads real back. The hidden frames are never heard or
+// kept; the only effect is that a key press shows up on screen that many frames sooner.
+static void runAheadOf(Chip8 *chip8, Chip8State *real, int frames, int frameBudget) {
+    saveChip8State(chip8, real);
+    for (int frame = 0; frame < frames; ++frame) {
+        runBudget(chip8, frameBudget);
+        endFrame(chip8);
+    }
+}
+
+// Uploads the picture from frames ahead (see runAheadOf). Returns 1 if anything was uploaded.
+static int uploadRunAhead(Chip8 *chip8, Renderer *renderer, int frames, int frameBudget,
+                          Uint64 *phaseStart) {
+    Chip8State real;
+    runAheadOf(chip8, &real, frames, frameBudget);
+    *phaseStart = endPhase(&frameStats, PHASE_EXECUTE, *phaseStart);
+    int uploaded = uploadDisplay(renderer, &chip8->display);
+    // also marks the whole screen dirty, so the next present replaces the lookahead picture
+    loadChip8State(chip8, &real);
+    return uploaded;
+}
+
+// Draws and presents the texture, with the overlay on top when it is enabled.
+// Without the overlay nothing is presented unless something was uploaded.
+static void presentFrame(Renderer *renderer, int uploaded, Uint64 phaseStart) {
+    if (!uploaded && !frameStats.overlay) {
+        endPhase(&frameStats, PHASE_RENDER, phaseStart);
+        return;
+    }
+    drawDisplay(renderer);
+    if (frameStats.overlay) {
+        drawFrameStatsOverlay(&frameStats, renderer->renderer, renderer->width, renderer->height);
+    }
+    phaseStart = endPhase(&frameStats, PHASE_RENDER, phaseStart);
+    presentRenderer(renderer);
+    endPhase(&frameStats, PHASE_PRESENT, phaseStart);
+}
+
+// Shows the frame time percentiles in the title bar while the overlay is up.
+// Called once a frame, but only touches the title twice a second.
+static void updateOverlayTitle(Renderer *renderer) {
+    if (!frameStats.overlay || frameStats.frames % 30 != 0) {
+        return;
+    }
+    char title[256];
+    snprintf(title, sizeof(title), "%s | frame p50 %.1f p99 %.1f max %.1f ms | busy p99 %.2f ms",
+             windowTitle,
+             frameStatsPercentile(&frameStats, SERIES_INTERVAL, 0.50) / 1e6,
+             frameStatsPercentile(&frameStats, SERIES_INTERVAL, 0.99) / 1e6,
+             frameStats.max[SERIES_INTERVAL] / 1e6,
+             frameStatsPercentile(&frameStats, SERIES_BUSY, 0.99) / 1e6);
+    SDL_SetWindowTitle(renderer->window, title);
+}
+
+// Turns an SDL event into a command for the emulator. Events that only concern the window
+// (F3, the window being exposed) are handled here against shown, the display being presented.
+// Returns 0 if there is nothing for the emulator to do.
+static int translateEvent(SDL_Event *event, Display *shown, InputCommand *command) {
+    if (event->type == SDL_QUIT) {
+        command->type = INPUT_QUIT;
+        return 1;
+    } else if (event->type == SDL_WINDOWEVENT) {
+        // the window contents may have been lost. redraw on the next frame
+        markDisplayDirty(shown);
+        return 0;
+    } else if (event->type != SDL_KEYDOWN && event->type != SDL_KEYUP) {
+        return 0;
+    }
+
+    bool down = event->type == SDL_KEYDOWN;
+    SDL_Keycode sym = event->key.keysym.sym;
+    if (down && !event->key.repeat) {
+        if (sym == SDLK_F5) {
+            command->type = INPUT_SAVE_STATE;
+            return 1;
+        } else if (sym == SDLK_F9) {
+            command->type = INPUT_LOAD_STATE;
+            return 1;
+        } else if (sym == SDLK_F3) {
+            frameStats.overlay = !frameStats.overlay;
+            // redraw without the overlay straight away
+            markDisplayDirty(shown);
+            return 0;
+        }
+    }
+    if (sym == SDLK_BACKSPACE) {
+        command->type = down ? INPUT_REWIND_START : INPUT_REWIND_STOP;
+        return 1;
+    }
+    if (down && sym == SDLK_F6) {
+        // frame advance. Repeats while held
+        command->type = INPUT_FRAME_ADVANCE;
+        return 1;
+    }
+    int key = keyForEvent(event);
+    if (key < 0) {
+        return 0;
+    }
+    command->type = down ? INPUT_KEY_DOWN : INPUT_KEY_UP;
+    command->key = key;
+    return 1;
+}
+
+// Carries out a command on the machine. Returns false when the emulator should quit.
+static bool applyInput(Chip8 *chip8, Scheduler *scheduler, InputCommand command) {
+    switch (command.type) {
+        case INPUT_KEY_DOWN:
+            pressKey(chip8, command.key);
+            break;
+        case INPUT_KEY_UP:
+            releaseKey(chip8, command.key);
+            break;
+        case INPUT_SAVE_STATE:
+            saveState(chip8);
+            break;
+        case INPUT_LOAD_STATE:
+            loadState(chip8);
+            break;
+        case INPUT_REWIND_START:
+        case INPUT_REWIND_STOP:
+            rewinding = command.type == INPUT_REWIND_START;
+            break;
+        case INPUT_FRAME_ADVANCE:
+            if (scheduler->mode == SCHEDULE_FIXED_STEP) {
+                requestFrames(scheduler, 1);
+            }
+            break;
+        case INPUT_QUIT:
+            return false;
+    }
+    return true;
+}
+
+// Handles one SDL event. Returns false when the emulator should quit.
+static bool handleEvent(Chip8 *chip8, Scheduler *scheduler, SDL_Event *event) {
+    InputCommand command;
+    if (!translateEvent(event, &chip8->display, &command)) {
+        return true;
+    }
+    return applyInput(chip8, scheduler, command);
+}
+
+// check for user interaction
+// The way SDL_PollEvent works is it invokes SDL_PumpEvents internally
+// then loops through the events in the queue while popping them out.
+// This was why the events weren't being found in other calls when
+// recalling SDL_PollEvent. (Key presses were being registered then dequeued)
+static bool pollEvents(Chip8 *chip8, Scheduler *scheduler) {
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+        if (!handleEvent(chip8, scheduler, &event)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Sleeps until the next frame is due, waking early to handle input.
+// Returns false when the emulator should quit.
+static bool idleUntilNextFrame(Chip8 *chip8, Scheduler *scheduler) {
+    Uint32 ms;
+    while ((ms = timeUntilNextFrame(scheduler)) > 0) {
+        SDL_Event event;
+        if (SDL_WaitEventTimeout(&event, ms) && !handleEvent(chip8, scheduler, &event)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// With --threaded the frame loop runs on its own thread and the main thread only handles
+// the window. Input reaches the emulator through a lock-free queue and frames come back
+// through a triple buffer, so a slow present or a stalled window manager never holds up
+// emulation. Everything here except frames, input and running belongs to the emulator
+// thread until it exits.
+typedef struct {
+    Chip8 *chip8;
+    Scheduler *scheduler;
+    Rewind *rewind;
+    Audio *audio;
+    // NULL unless --auto-ipf, in which case it sets frameBudget after every frame
+    Tuner *tuner;
+    int frameBudget;
+    int pollInterval;
+    int runAhead;
+    uint64_t frameLimit;
+    uint64_t instructionsExecuted;
+
+    TripleBuffer frames;
+    InputQueue input;
+    // cleared by either thread to stop both
+    atomic_int running;
+} Emulator;
+
+// Applies everything the window has sent since the last call. Returns false on quit.
+static bool drainInput(Emulator *emulator) {
+    InputCommand command;
+    while (popInput(&emulator->input, &command)) {
+        if (!applyInput(emulator->chip8, emulator->scheduler, command)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Hands the current picture, or the one runAhead frames on, to the window thread
+static void publishFrame(Emulator *emulator, int runAhead) {
+    Chip8 *chip8 = emulator->chip8;
+    DisplayFrame *frame = tripleBufferBack(&emulator->frames);
+    if (runAhead > 0) {
+        Chip8State real;
+        runAheadOf(chip8, &real, runAhead, emulator->frameBudget);
+        memcpy(frame->planes, chip8->display.planes, sizeof(frame->planes));
+        frame->hires = chip8->display.hires;
+        loadChip8State(chip8, &real);
+    } else {
+        memcpy(frame->planes, chip8->display.planes, sizeof(frame->planes));
+        frame->hires = chip8->display.hires;
+    }
+    publishTripleBuffer(&emulator->frames);
+}
+
+// The emulator thread. The same frame loop as main's, minus the window
+static int emulatorThread(void *data) {
+    Emulator *emulator = (Emulator *)data;
+    Chip8 *chip8 = emulator->chip8;
+    Scheduler *scheduler = emulator->scheduler;
+    bool running = true;
+    while (running && atomic_load(&emulator->running)) {
+        if (!beginFrame(scheduler)) {
+            // fixed step with nothing requested
+            SDL_Delay(1);
+            running = drainInput(emulator);
+            continue;
+        }
+        running = drainInput(emulator);
+
+        if (rewinding && emulator->rewind != NULL) {
+            rewindChip8(emulator->rewind, chip8);
+            updateAudio(emulator->audio, chip8);
+            publishFrame(emulator, 0);
+            continue;
+        }
+        if (emulator->rewind != NULL) {
+            pushRewind(emulator->rewind, chip8);
+        }
+
+        if (emulator->tuner != NULL) {
+            beginTunedFrame(emulator->tuner, chip8);
+        }
+        int remaining = emulator->frameBudget;
+        int executed = 0;
+        while (remaining > 0 && running) {
+            int chunk = emulator->pollInterval > 0 && emulator->pollInterval < remaining
+                            ? emulator->pollInterval : remaining;
+            executed += runBudget(chip8, chunk);
+            remaining -= chunk;
+            updateAudio(emulator->audio, chip8);
+            if (remaining > 0) {
+                running = drainInput(emulator);
+            }
+        }
+
+        endFrame(chip8);
+        updateAudio(emulator->audio, chip8);
+        emulator->instructionsExecuted += executed;
+        if (emulator->tuner != NULL) {
+            emulator->frameBudget = endTunedFrame(emulator->tuner, chip8, executed);
+        }
 
-    // reset pressed key states
-    for (int i = 0; i < KEYS; i++) {
-        pressedKeys[i] = 0;
+        if (scheduler->mode != SCHEDULE_TURBO || realFrameElapsed(scheduler)) {
+            publishFrame(emulator, emulator->runAhead);
+        }
+
+        if (emulator->frameLimit != 0 && scheduler->frameCount >= emulator->frameLimit) {
+            running = false;
+        }
     }
+    atomic_store(&emulator->running, 0);
+    return 0;
+}
 
-    // generate seed for randomly generated numbers 
-    // (rand() would always be the same otherwise)
-    srand(time(NULL));
+// The window side of --threaded. Forwards events and presents each new frame as it arrives.
+// shown holds the frame as last presented, so only the rows that changed are uploaded.
+static void runWindow(Emulator *emulator, Renderer *renderer, Display *shown) {
+    while (atomic_load(&emulator->running)) {
+        SDL_Event event;
+        // sleep on the event queue between frames. Waking every 1ms picks new frames up promptly
+        if (SDL_WaitEventTimeout(&event, 1)) {
+            Uint64 phaseStart = SDL_GetPerformanceCounter();
+            do {
+                InputCommand command;
+                if (translateEvent(&event, shown, &command)) {
+                    if (command.type == INPUT_QUIT) {
+                        atomic_store(&emulator->running, 0);
+                    }
+                    pushInput(&emulator->input, command);
+                }
+            } while (SDL_PollEvent(&event));
+            endPhase(&frameStats, PHASE_POLL, phaseStart);
+        }
+
+        const DisplayFrame *frame = consumeTripleBuffer(&emulator->frames);
+        if (frame == NULL) {
+            continue;
+        }
+        beginFrameStats(&frameStats);
+        updateOverlayTitle(renderer);
+        Uint64 phaseStart = SDL_GetPerformanceCounter();
+        if (frame->hires != shown->hires) {
+            setHires(shown, frame->hires);
+        }
+        for (int plane = 0; plane < DISPLAY_PLANES; ++plane) {
+            for (int y = 0; y < DISPLAY_HEIGHT; ++y) {
+                if (frame->planes[plane][y] != shown->planes[plane][y]) {
+                    shown->planes[plane][y] = frame->planes[plane][y];
+                    shown->dirtyRows |= (uint64_t)1 << y;
+                }
+            }
+        }
+        presentFrame(renderer, uploadDisplay(renderer, shown), phaseStart);
+    }
+}
+
+int main(int argc, char **argv) {
+    // 64KB of memory plus its decoded instructions. Too big for the stack
+    static Chip8 chip8;
+    initializeChip8(&chip8);
 
     // Load ROM into memory starting at 0x200
-    //FILE *rom = fopen("TestROMs/Breakout [Carmelo Cortez, 1979].ch8", "rb");
-    FILE *rom = fopen("TestROMs/Pong (1 player).ch8", "rb");
-    //FILE *rom = fopen("TestROMs/Hi-Lo [Jef Winsor, 1978].ch8", "rb");
-    //FILE *rom = fopen("TestROMs/chiptest-offstatic.ch8", "rb");
-    if (rom == NULL) {
+    //const char *romPath = "TestROMs/Breakout [Carmelo Cortez, 1979].ch8";
+    const char *romPath = "TestROMs/Pong (1 player).ch8";
+    //const char *romPath = "TestROMs/Hi-Lo [Jef Winsor, 1978].ch8";
+    //const char *romPath = "TestROMs/chiptest-offstatic.ch8";
+    // present synchronised to the monitor refresh
+    int vsync = 0;
+    ScheduleMode scheduleMode = SCHEDULE_REALTIME;
+    // quit after this many frames. 0 runs until the window is closed
+    uint64_t frameLimit = 0;
+    // seed for Cxkk's random numbers. A new one every run unless --seed gives one to replay
+    uint64_t seed = time(NULL);
+    // frames to emulate ahead of what is shown. 0 disables run-ahead
+    int runAhead = 0;
+    // per-frame timings are written here on exit
+    const char *frameStatsPath = NULL;
+    // input is sampled once per frame, or every this many instructions (machine cycles with
+    // --timing vip) when it isn't 0
+    int pollInterval = 0;
+    // run the frame loop on its own thread
+    bool threaded = false;
+    // instructions per frame from --ipf. 0 takes the ROM's rate from the database, or 9
+    int fixedRate = 0;
+    // --auto-ipf adjusts instructions per frame between these as the ROM runs (see Tuner.h)
+    bool autoRate = false;
+    int minimumRate = TUNER_DEFAULT_MIN;
+    int maximumRate = TUNER_DEFAULT_MAX;
+    const char *databasePath = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--vsync") == 0) {
+            vsync = 1;
+        } else if (strcmp(argv[i], "--turbo") == 0) {
+            scheduleMode = SCHEDULE_TURBO;
+        } else if (strcmp(argv[i], "--fixed-step") == 0) {
+            scheduleMode = SCHEDULE_FIXED_STEP;
+        } else if (strcmp(argv[i], "--threaded") == 0) {
+            threaded = true;
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            chip8.jit = createJit();
+            if (chip8.jit == NULL) {
+                fprintf(stderr, "The recompiler isn't available on this host. Interpreting instead\n");
+            }
+        } else if (strcmp(argv[i], "--ipf") == 0 && i + 1 < argc) {
+            fixedRate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--auto-ipf") == 0) {
+            autoRate = true;
+        } else if (strcmp(argv[i], "--ipf-min") == 0 && i + 1 < argc) {
+            minimumRate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ipf-max") == 0 && i + 1 < argc) {
+            maximumRate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rom-db") == 0 && i + 1 < argc) {
+            databasePath = argv[++i];
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frameLimit = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--run-ahead") == 0 && i + 1 < argc) {
+            runAhead = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--keymap") == 0 && i + 1 < argc) {
+            if (loadKeymap(argv[++i]) != 0) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--poll-every") == 0 && i + 1 < argc) {
+            pollInterval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--frame-stats") == 0 && i + 1 < argc) {
+            frameStatsPath = argv[++i];
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+            int profile = parseQuirks(argv[++i]);
+            if (profile < 0) {
+                fprintf(stderr, "Unknown quirk profile %s. Use default, vip, chip48, schip or xochip\n", argv[i]);
+                return 1;
+            }
+            setQuirks(&chip8, profile);
+        } else if (strcmp(argv[i], "--timing") == 0 && i + 1 < argc) {
+            const char *timing = argv[++i];
+            if (strcmp(timing, "vip") == 0) {
+                vipTiming = true;
+            } else if (strcmp(timing, "fixed") != 0) {
+                fprintf(stderr, "Unknown timing %s. Use fixed or vip\n", timing);
+                return 1;
+            }
+        } else {
+            romPath = argv[i];
+        }
+    }
+    if (loadRom(&chip8, romPath) != 0) {
         fprintf(stderr, "Failed to open ROM\n");
         return 1;
     }
-    fread(chip8.memory + 0x200, 1, MEMORY_SIZE - 0x200, rom);
-    fclose(rom);
+    if (autoRate && vipTiming) {
+        fprintf(stderr, "--auto-ipf tunes instructions per frame, which --timing vip doesn't use\n");
+        return 1;
+    }
+
+    // docs and other resources online recommend this to be at 11
+    // but it appears to run best on my machine at 9. especially for games like Breakout
+    int instructionsPerFrame = 9;
+    // a rate pinned for this ROM in the database, unless --ipf overrides it. The default
+    // database is optional; one named with --rom-db has to be there
+    bool databaseNamed = databasePath != NULL;
+    if (!databaseNamed) {
+        databasePath = DEFAULT_ROM_DATABASE;
+    }
+    uint64_t romHash = hashRomFile(romPath);
+    int pinnedRate = lookupRomRate(databasePath, romHash);
+    if (pinnedRate < 0 && databaseNamed) {
+        fprintf(stderr, "Can't open ROM database %s\n", databasePath);
+        return 1;
+    }
+    if (fixedRate > 0) {
+        instructionsPerFrame = fixedRate;
+    } else if (pinnedRate > 0) {
+        instructionsPerFrame = pinnedRate;
+        fprintf(stderr, "%d instructions per frame, pinned in %s\n", pinnedRate, databasePath);
+    }
+    // 4 KB of counts. Static like chip8
+    static Tuner tuner;
+    if (autoRate) {
+        initTuner(&tuner, minimumRate, maximumRate, instructionsPerFrame);
+        instructionsPerFrame = tuner.instructionsPerFrame;
+        if (chip8.jit != NULL) {
+            // compiled blocks run wait loops like any other code, so the tuner couldn't see them
+            fprintf(stderr, "--auto-ipf measures the interpreter's wait loops, so the recompiler isn't used\n");
+            destroyJit(chip8.jit);
+            chip8.jit = NULL;
+        }
+    }
+    seedChip8(&chip8, seed);
+    fprintf(stderr, "Seed: %llu\n", (unsigned long long)seed);
+    snprintf(statePath, sizeof(statePath), "%s.state", romPath);
+    Rewind *rewind = createRewind(REWIND_FRAMES, REWIND_KEYFRAME_INTERVAL);
 
     // Print memory at address 0x200
     //printf("Memory at 0x200: %02X%02X\n", chip8.memory[0x200], chip8.memory[0x201]);
 
-    initDisplay(&chip8.display, "CHIP-8 Emulator", DISPLAY_WIDTH * 10, DISPLAY_HEIGHT * 10);
-
-    // Set a few pixels in the corners for testing
-    // setPixel(&chip8.display, 0, 0, RED_VAL, GREEN_VAL, BLUE_VAL, ALPHA_VAL);
-    // setPixel(&chip8.display, DISPLAY_WIDTH - 1, 0, RED_VAL, GREEN_VAL, BLUE_VAL, ALPHA_VAL);
-    // setPixel(&chip8.display, 0, DISPLAY_HEIGHT - 1, RED_VAL, GREEN_VAL, BLUE_VAL, ALPHA_VAL);
-    // setPixel(&chip8.display, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT - 1, RED_VAL, GREEN_VAL, BLUE_VAL, ALPHA_VAL);
-    // updateDisplay(&chip8.display);
+    Renderer renderer;
+    if (initRenderer(&renderer, windowTitle, LORES_WIDTH * 10, LORES_HEIGHT * 10, vsync) != 0) {
+        fprintf(stderr, "Failed to create window: %s\n", SDL_GetError());
+        return 1;
+    }
 
     // for measuring time to obtain 60hz/60fps
     // A close benchmark for attempting to match the Cosmac VIP which
@@ -71,248 +570,178 @@ int main(int argc, char **argv) {
     // The true implementation would try to emulate exact timings since they
     // all vary by instruction on the CPU, but that's not needed.
     // The user would know no different.
-    Uint32 lastTime = SDL_GetTicks();
-    double delta = 0;
-    // docs and other resources online recommend this to be at 11
-    // but it appears to run best on my machine at 9. especially for games like Breakout
-    int instructionsPerFrame = 9;
-    int instructionsExecutedThisFrame = 0;
-
-    // Sound
-    SDL_Init(SDL_INIT_AUDIO);
-
-    SDL_AudioSpec spec = {0};
-    spec.freq = 14100;
-    spec.format = AUDIO_S16SYS;
-    spec.channels = 1; // mono. 2 is stereo
-    spec.samples = 256;
-    spec.callback = my_audio_callback;
-    spec.userdata = NULL;
-    //SDL_OpenAudio(&spec, NULL);
-    SDL_AudioDeviceID device_id = SDL_OpenAudioDevice(NULL, 0, &spec, NULL, 0);
-
-    SDL_PauseAudioDevice(device_id, 0);
-    SDL_Delay(2000); // 2 seconds of audio
-    SDL_PauseAudioDevice(device_id, 1);
-    SDL_Delay(500);
-    bool playingAudio = false;
-    // Audio countdown test
-    for (int i = 0; i < 3; i++) {
-        SDL_PauseAudioDevice(device_id, 0);
-        SDL_Delay(500);
-        SDL_PauseAudioDevice(device_id, 1);
-        SDL_Delay(500);
-    }
-
-    // Main emulation loop
-    for (;;) {
-        // check for user interaction
-        // The way SDL_PollEvent works is it invokes SDL_PumpEvents internally
-        // then loops through the events in the queue while popping them out.
-        // This was why the events weren't being found in other calls when
-        // recalling SDL_PollEvent. (Key presses were being registered then dequeued)
-        SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_QUIT) {
-                destroyDisplay(&chip8.display);
-                SDL_CloseAudioDevice(device_id);
-                SDL_Quit();
-                return 0;
-            } else if (event.type == SDL_KEYDOWN) {
-                for (int i = 0; i < KEYS; i++) {
-                    if (event.key.keysym.sym == Keypad[i]) {
-                        pressedKeys[i] = i;
-                    }
-                }
-            } else if (event.type == SDL_KEYUP) {
-                for (int i = 0; i < KEYS; ++i) {
-                    if (event.key.keysym.sym == Keypad[i]) {
-                        pressedKeys[i] = 0;
-                    }
-                }
+    Scheduler scheduler;
+    initScheduler(&scheduler, scheduleMode, 60);
+    if (scheduleMode == SCHEDULE_FIXED_STEP) {
+        fprintf(stderr, "Fixed step mode. Press F6 to advance one frame\n");
+    }
+    // what each frame runs: instructionsPerFrame, or the cycles the VIP had between interrupts
+    int frameBudget = vipTiming ? VIP_FRAME_BUDGET : instructionsPerFrame;
+    if (vipTiming && chip8.jit != NULL) {
+        fprintf(stderr, "VIP timing counts cycles per instruction, so the recompiler isn't used\n");
+    }
+    uint64_t instructionsExecuted = 0;
+    if (initFrameStats(&frameStats) != 0) {
+        fprintf(stderr, "Not enough memory for the frame time history. Only percentiles will be kept\n");
+    }
+
+    // the beeper runs on SDL's audio thread. The loop only tells it whether the sound timer is running
+    Audio audio;
+    if (initAudio(&audio) != 0) {
+        fprintf(stderr, "No audio device: %s\n", SDL_GetError());
+    }
+
+    bool running = true;
+    // the display whose present counts are reported on exit
+    Display *presented = &chip8.display;
+    Emulator emulator;
+    Display shown;
+    if (threaded) {
+        emulator.chip8 = &chip8;
+        emulator.scheduler = &scheduler;
+        emulator.rewind = rewind;
+        emulator.audio = &audio;
+        emulator.tuner = autoRate ? &tuner : NULL;
+        emulator.frameBudget = frameBudget;
+        emulator.pollInterval = pollInterval;
+        emulator.runAhead = runAhead;
+        emulator.frameLimit = frameLimit;
+        emulator.instructionsExecuted = 0;
+        initTripleBuffer(&emulator.frames);
+        initInputQueue(&emulator.input);
+        atomic_init(&emulator.running, 1);
+        initDisplay(&shown);
+
+        SDL_Thread *thread = SDL_CreateThread(emulatorThread, "emulator", &emulator);
+        if (thread != NULL) {
+            runWindow(&emulator, &renderer, &shown);
+            SDL_WaitThread(thread, NULL);
+            instructionsExecuted = emulator.instructionsExecuted;
+            presented = &shown;
+            // the loop below already ran on the emulator thread
+            running = false;
+        } else {
+            fprintf(stderr, "Couldn't start the emulator thread: %s. Running single threaded\n", SDL_GetError());
+        }
+    }
+
+    // Main emulation loop. One pass per emulated 60hz frame.
+    while (running) {
+        if (chip8.waitingForKey && scheduleMode != SCHEDULE_FIXED_STEP) {
+            // nothing to execute until a key arrives. sleep on the event queue
+            // rather than in beginFrame so the key is handled the moment it comes in
+            running = idleUntilNextFrame(&chip8, &scheduler);
+            if (!running) {
+                break;
             }
         }
 
-        // Measure game frames at 60Hz
-        Uint32 currentTime = SDL_GetTicks();
-        delta = (currentTime - lastTime);
-        bool nextFrame = false;
-        if (delta >= 1000.0 / 60.0) {
-            //fprintf(stderr, "frame detected at %d - %d = %f\n", currentTime, lastTime, delta);
-            lastTime = currentTime;
-            delta = 0;
-            nextFrame = true;
+        if (!beginFrame(&scheduler)) {
+            // fixed step with nothing requested. sleep until the user does something
+            SDL_Event event;
+            if (SDL_WaitEventTimeout(&event, 100)) {
+                running = handleEvent(&chip8, &scheduler, &event);
+            }
+            continue;
         }
 
-        if (instructionsExecutedThisFrame >= instructionsPerFrame && nextFrame == false) {
+        beginFrameStats(&frameStats);
+        updateOverlayTitle(&renderer);
+        // each step below charges the time since the last one to its phase
+        Uint64 phaseStart = SDL_GetPerformanceCounter();
+
+        running = pollEvents(&chip8, &scheduler);
+        phaseStart = endPhase(&frameStats, PHASE_POLL, phaseStart);
+
+        if (rewinding && rewind != NULL) {
+            // show the previous frame instead of running a new one
+            rewindChip8(rewind, &chip8);
+            updateAudio(&audio, &chip8);
+            phaseStart = endPhase(&frameStats, PHASE_EXECUTE, phaseStart);
+            presentFrame(&renderer, uploadDisplay(&renderer, &chip8.display), phaseStart);
             continue;
         }
+        if (rewind != NULL) {
+            pushRewind(rewind, &chip8);
+        }
 
-        // Fetch opcode using bitwise or operator. 
-        // First byte is the high byte. second byte is the low byte.
-        chip8.opcode = chip8.memory[chip8.pc] << 8 | chip8.memory[chip8.pc + 1];
-
-        bool isDraw = false;
-        // Decode and execute opcode
-        switch (chip8.opcode & 0xF000) {
-            case 0x0000:
-                switch (chip8.opcode & 0x00FF) {
-                    case 0x00E0:
-                        opcode_00E0(&chip8);
-                        break;
-                    case 0x00EE:
-                        opcode_00EE(&chip8);
-                        break;
-                    default:
-                        fprintf(stderr, "Unknown opcode: %04X\n", chip8.opcode);
-                        break;
-                }
-                break;
-            case 0x1000:
-                opcode_1nnn(&chip8);
-                break;
-            case 0x2000:
-                opcode_2nnn(&chip8);
-                break;
-            case 0x3000:
-                opcode_3xkk(&chip8);
-                break;
-            case 0x4000:
-                opcode_4xkk(&chip8);
-                break;
-            case 0x5000:
-                opcode_5xy0(&chip8);
-                break;
-            case 0x6000:
-                opcode_6xnn(&chip8);
-                break;
-            case 0x7000:
-                opcode_7xkk(&chip8);
-                break;
-            case 0x8000:
-                switch (chip8.opcode & 0x000F) {
-                    case 0x0000:
-                        opcode_8xy0(&chip8);
-                        break;
-                    case 0x0001:
-                        opcode_8xy1(&chip8);
-                        break;
-                    case 0x0002:
-                        opcode_8xy2(&chip8);
-                        break;
-                    case 0x0003:
-                        opcode_8xy3(&chip8);
-                        break;
-                    case 0x0004:
-                        opcode_8xy4(&chip8);
-                        break;
-                    case 0x0005:
-                        opcode_8xy5(&chip8);
-                        break;
-                    case 0x0006:
-                        opcode_8xy6(&chip8);
-                        break;
-                    case 0x0007:
-                        opcode_8xy7(&chip8);
-                        break;
-                    case 0x000E:
-                        opcode_8xyE(&chip8);
-                        break;
-                    default:
-                        fprintf(stderr, "Unknown opcode: %04X\n", chip8.opcode);
-                        break;
-                }
-                break;
-            case 0x9000:
-                opcode_9xy0(&chip8);
-                break;
-            case 0xA000:
-                opcode_Annn(&chip8);
-                break;
-            case 0xB000:
-                opcode_Bnnn(&chip8);
-                break;
-            case 0xC000:
-                opcode_Cxkk(&chip8);
-                break;
-            case 0xD000:
-                opcode_Dxyn(&chip8);
-                isDraw = true;
-                break;
-            case 0xE000:
-                switch (chip8.opcode & 0x00FF) {
-                    case 0x009E:
-                        opcode_Ex9E(&chip8);
-                        break;
-                    case 0x00A1:
-                        opcode_ExA1(&chip8);
-                        break;
-                    default:
-                        fprintf(stderr, "Unknown opcode: %04X\n", chip8.opcode);
-                        break;
-                }
-                break;
-            case 0xF000:
-                switch (chip8.opcode & 0x00FF) {
-                    case 0x0007:
-                        opcode_Fx07(&chip8);
-                        break;
-                    case 0x000A:
-                        opcode_Fx0A(&chip8);
-                        break;
-                    case 0x0015:
-                        opcode_Fx15(&chip8);
-                        break;
-                    case 0x0018:
-                        opcode_Fx18(&chip8);
-                        break;
-                    case 0x001E:
-                        opcode_Fx1E(&chip8);
-                        break;
-                    case 0x0029:
-                        opcode_Fx29(&chip8);
-                        break;
-                    case 0x0033:
-                        opcode_Fx33(&chip8);
-                        break;
-                    case 0x0055:
-                        opcode_Fx55(&chip8);
-                        break;
-                    case 0x0065:
-                        opcode_Fx65(&chip8);
-                        break;
-                    default:
-                        fprintf(stderr, "Unknown opcode: %04X\n", chip8.opcode);
-                        break;
-                }
-                break;
-            default:
-                fprintf(stderr, "Unknown opcode: %04X\n", chip8.opcode);
-                break;
+        if (autoRate) {
+            beginTunedFrame(&tuner, &chip8);
         }
+        // the frame's budget runs in one go, or in chunks of pollInterval with input sampled between
+        int remaining = frameBudget;
+        int executed = 0;
+        while (remaining > 0 && running) {
+            int chunk = pollInterval > 0 && pollInterval < remaining ? pollInterval : remaining;
+            // runChip8 stops early if Fx0A halts the CPU. The timers, audio and
+            // display keep going until pressKey releases it
+            executed += runBudget(&chip8, chunk);
+            remaining -= chunk;
+            updateAudio(&audio, &chip8);
 
-        instructionsExecutedThisFrame++;
+            if (remaining > 0) {
+                phaseStart = endPhase(&frameStats, PHASE_EXECUTE, phaseStart);
+                running = pollEvents(&chip8, &scheduler);
+                phaseStart = endPhase(&frameStats, PHASE_POLL, phaseStart);
+            }
+        }
 
-        if (chip8.sound_timer > 0 && playingAudio == false) {
-            playingAudio = true;
-            SDL_PauseAudioDevice(device_id, 0); // start audio
-        } else if (chip8.sound_timer == 0 && playingAudio == true) {
-            playingAudio = false;
-            SDL_PauseAudioDevice(device_id, 1); // stop audio
+        // Update timers at the end of every emulated frame
+        endFrame(&chip8);
+        updateAudio(&audio, &chip8);
+        instructionsExecuted += executed;
+        if (autoRate) {
+            frameBudget = endTunedFrame(&tuner, &chip8, executed);
         }
+        phaseStart = endPhase(&frameStats, PHASE_EXECUTE, phaseStart);
 
-        // Update timers at 60hz
-        if (nextFrame) {
-            if (chip8.delay_timer > 0) {
-                --chip8.delay_timer;
-            }
-            if (chip8.sound_timer > 0) {
-                --chip8.sound_timer;
+        // upload and present at most once per frame, and only if something changed.
+        // turbo runs many emulated frames per real one, so only present at the real rate
+        if (scheduleMode != SCHEDULE_TURBO || realFrameElapsed(&scheduler)) {
+            int uploaded;
+            if (runAhead > 0) {
+                uploaded = uploadRunAhead(&chip8, &renderer, runAhead, frameBudget, &phaseStart);
+            } else {
+                uploaded = uploadDisplay(&renderer, &chip8.display);
             }
-            instructionsExecutedThisFrame = 0;
+            presentFrame(&renderer, uploaded, phaseStart);
+        }
+
+        if (frameLimit != 0 && scheduler.frameCount >= frameLimit) {
+            running = false;
+        }
+    }
+
+    double seconds = elapsedSeconds(&scheduler);
+    fprintf(stderr, "Ran %llu frames, %llu instructions in %.2fs (%.0f instructions/s)\n",
+            (unsigned long long)scheduler.frameCount, (unsigned long long)instructionsExecuted,
+            seconds, instructionsExecuted / seconds);
+    fprintf(stderr, "Frames presented: %u, skipped (unchanged): %u\n",
+            presented->framesPresented, presented->framesSkipped);
+    if (autoRate) {
+        reportTunedRate(&tuner, romPath, romHash, databasePath);
+    }
+    if (rewind != NULL) {
+        fprintf(stderr, "Rewind history: %d frames in %zu bytes\n", rewindLength(rewind), rewindBytes(rewind));
+    }
+    printFrameStatsSummary(&frameStats, stderr);
+    if (frameStatsPath != NULL) {
+        if (writeFrameStatsCsv(&frameStats, frameStatsPath) == 0) {
+            fprintf(stderr, "Frame times written to %s\n", frameStatsPath);
+        } else {
+            fprintf(stderr, "Failed to write frame times to %s\n", frameStatsPath);
         }
-        
     }
+#ifdef CHIP8_PROFILE
+    saveProfileReport("profile.txt");
+#endif
+    destroyFrameStats(&frameStats);
+    destroyRewind(rewind);
+    destroyJit(chip8.jit);
+    // before destroyRenderer, which shuts SDL down
+    destroyAudio(&audio);
+    destroyRenderer(&renderer);
+    SDL_Quit();
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,30 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+// PCG32 (XSH RR variant, pcg-random.org). The whole generator is one 64-bit word, so each
+// Chip8 carries its own, copying a machine copies its random sequence, and a given seed
+// always replays the same numbers.
+
+#define PCG32_MULTIPLIER 6364136223846793005ull
+#define PCG32_INCREMENT 1442695040888963407ull
+
+// Returns the next 32 random bits and advances the state
+static inline uint32_t pcg32Next(uint64_t *state) {
+    uint64_t old = *state;
+    *state = old * PCG32_MULTIPLIER + PCG32_INCREMENT;
+    uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+    uint32_t rot = (uint32_t)(old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+// Sets the state for a seed the way the reference implementation does
+static inline void pcg32Seed(uint64_t *state, uint64_t seed) {
+    *state = 0;
+    pcg32Next(state);
+    *state += seed;
+    pcg32Next(state);
+}
+
+#endif // RANDOM_H
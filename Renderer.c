@@ -0,0 +1,105 @@
+#include "Renderer.h"
+
+#define ON_COLOR ((ALPHA_VAL << 24) | (RED_VAL << 16) | (GREEN_VAL << 8) | BLUE_VAL)
+#define OFF_COLOR (ALPHA_VAL << 24)
+// XO-CHIP's second plane, on its own and together with the first
+#define PLANE2_COLOR ((ALPHA_VAL << 24) | (255 << 16) | (96 << 8) | 32)
+#define BOTH_COLOR ((ALPHA_VAL << 24) | (255 << 16) | (255 << 8) | 255)
+
+// indexed by a pixel's plane bits. Single plane programs only use the first two
+static const uint32_t palette[4] = {OFF_COLOR, ON_COLOR, PLANE2_COLOR, BOTH_COLOR};
+
+int initRenderer(Renderer *renderer, const char *title, int width, int height, int vsync) {
+    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+        return -1;
+    }
+
+    renderer->window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_SHOWN);
+    if (renderer->window == NULL) {
+        SDL_Quit();
+        return -1;
+    }
+
+    Uint32 flags = SDL_RENDERER_ACCELERATED;
+    if (vsync) {
+        flags |= SDL_RENDERER_PRESENTVSYNC;
+    }
+    renderer->renderer = SDL_CreateRenderer(renderer->window, -1, flags);
+    if (renderer->renderer == NULL) {
+        SDL_DestroyWindow(renderer->window);
+        SDL_Quit();
+        return -1;
+    }
+
+    // nearest neighbour scaling keeps the pixels sharp
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+    renderer->texture = SDL_CreateTexture(renderer->renderer, SDL_PIXELFORMAT_ARGB8888,
+                                          SDL_TEXTUREACCESS_STREAMING, DISPLAY_WIDTH, DISPLAY_HEIGHT);
+    if (renderer->texture == NULL) {
+        SDL_DestroyRenderer(renderer->renderer);
+        SDL_DestroyWindow(renderer->window);
+        SDL_Quit();
+        return -1;
+    }
+
+    renderer->width = width;
+    renderer->height = height;
+    renderer->source = (SDL_Rect){0, 0, LORES_WIDTH, LORES_HEIGHT};
+
+    // clear window
+    SDL_SetRenderDrawColor(renderer->renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer->renderer);
+    SDL_RenderPresent(renderer->renderer);
+
+    return 0;
+}
+
+int renderDisplay(Renderer *renderer, Display *display) {
+    if (!uploadDisplay(renderer, display)) {
+        return 0;
+    }
+    drawDisplay(renderer);
+    presentRenderer(renderer);
+    return 1;
+}
+
+int uploadDisplay(Renderer *renderer, Display *display) {
+    uint64_t dirty = consumeDirtyRows(display);
+    if (dirty == 0) {
+        // nothing changed. The window still shows the last frame
+        return 0;
+    }
+
+    // upload the band of rows between the first and last dirty row.
+    // the texture keeps the rows outside of it from earlier uploads
+    int firstRow = __builtin_ctzll(dirty);
+    int lastRow = 63 - __builtin_clzll(dirty);
+    displayToPixels(display, renderer->pixels, firstRow, lastRow, palette);
+    renderer->source = (SDL_Rect){0, 0, displayWidth(display), displayHeight(display)};
+    SDL_Rect band = {0, firstRow, renderer->source.w, lastRow - firstRow + 1};
+    SDL_UpdateTexture(renderer->texture, &band, renderer->pixels + firstRow * DISPLAY_WIDTH,
+                      DISPLAY_WIDTH * sizeof(uint32_t));
+    return 1;
+}
+
+void drawDisplay(Renderer *renderer) {
+    SDL_RenderClear(renderer->renderer);
+    SDL_RenderCopy(renderer->renderer, renderer->texture, &renderer->source, NULL);
+}
+
+void presentRenderer(Renderer *renderer) {
+    SDL_RenderPresent(renderer->renderer);
+}
+
+void destroyRenderer(Renderer *renderer) {
+    if (renderer->texture != NULL) {
+        SDL_DestroyTexture(renderer->texture);
+    }
+    if (renderer->renderer != NULL) {
+        SDL_DestroyRenderer(renderer->renderer);
+    }
+    if (renderer->window != NULL) {
+        SDL_DestroyWindow(renderer->window);
+    }
+    SDL_Quit();
+}
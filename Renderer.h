@@ -0,0 +1,48 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <SDL2/SDL.h>
+
+#include "Display.h"
+
+#define RED_VAL 0
+#define GREEN_VAL 255
+#define BLUE_VAL 255
+#define ALPHA_VAL 255
+
+// SDL side of the display. Owns the window and a DISPLAY_WIDTH x DISPLAY_HEIGHT
+// streaming texture that the framebuffer is uploaded into once per frame.
+// SDL scales the part of the texture in use (all of it in hi-res, the top left
+// quarter in lo-res) up to the window when it is copied.
+typedef struct {
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+    SDL_Texture *texture;
+    int width;
+    int height;
+    // the part of the texture the last upload filled
+    SDL_Rect source;
+    // staging buffer for the texture upload, ARGB8888
+    uint32_t pixels[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+} Renderer;
+
+// Function to create the window, renderer and texture.
+// vsync locks SDL_RenderPresent to the monitor's refresh.
+int initRenderer(Renderer *renderer, const char *title, int width, int height, int vsync);
+
+// Function to upload the rows that changed since the last present and present them.
+// Does nothing (no upload, no present) when no rows changed. Returns 1 if it presented.
+int renderDisplay(Renderer *renderer, Display *display);
+
+// The steps of renderDisplay, for callers that draw over the display or time each step.
+// uploadDisplay copies the changed rows into the texture and returns 1 if there were any.
+int uploadDisplay(Renderer *renderer, Display *display);
+// Function to clear the window and draw the texture scaled up to it
+void drawDisplay(Renderer *renderer);
+// Function to show what has been drawn
+void presentRenderer(Renderer *renderer);
+
+// Function to destroy the renderer. Frees up the memory allocated to the texture, renderer and window
+void destroyRenderer(Renderer *renderer);
+
+#endif // RENDERER_H
@@ -0,0 +1,220 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "Rewind.h"
+#include "SaveState.h"
+
+typedef struct {
+    // run-length encoded XOR, see encodeXor
+    uint8_t *data;
+    uint32_t size;
+    uint8_t isKeyframe;
+} RewindEntry;
+
+struct Rewind {
+    RewindEntry *entries;
+    int capacity;
+    // ring indices. oldest is entries[first]
+    int first;
+    int count;
+
+    int keyframeInterval;
+    // snapshots from the newest keyframe (inclusive) to the newest snapshot
+    int sinceKeyframe;
+    int hasBase;
+    Chip8State base;
+    // decoded newest keyframe. Valid while sinceKeyframe > 0
+    Chip8State keyframe;
+
+    Chip8State scratch;
+    // worst case encoding of one state
+    uint8_t *encoded;
+    size_t bytes;
+};
+
+// Zero runs shorter than this are cheaper to store as literals
+#define MIN_ZERO_RUN 4
+// The most a token's counts can hold. A state is bigger than this (memory alone is 64 KB),
+// so longer runs are split over several tokens
+#define MAX_RUN 0xFFFF
+
+// Encodes a ^ b as repeated [u16 zero run][u16 literal count][literal bytes]
+static size_t encodeXor(const uint8_t *a, const uint8_t *b, size_t size, uint8_t *out) {
+    uint8_t *start = out;
+    size_t i = 0;
+    while (i < size) {
+        size_t zeros = 0;
+        while (i + zeros < size && zeros < MAX_RUN && a[i + zeros] == b[i + zeros]) {
+            zeros++;
+        }
+        i += zeros;
+
+        // literals run until the next zero run long enough to be worth a token
+        size_t literals = 0;
+        size_t run = 0;
+        while (i + literals + run < size && run < MIN_ZERO_RUN && literals + run < MAX_RUN) {
+            if (a[i + literals + run] == b[i + literals + run]) {
+                run++;
+            } else {
+                literals += run + 1;
+                run = 0;
+            }
+        }
+
+        *out++ = zeros & 0xFF;
+        *out++ = zeros >> 8;
+        *out++ = literals & 0xFF;
+        *out++ = literals >> 8;
+        for (size_t j = 0; j < literals; ++j) {
+            *out++ = a[i + j] ^ b[i + j];
+        }
+        i += literals;
+    }
+    return out - start;
+}
+
+// XORs an encoding from encodeXor back into state
+static void decodeXor(uint8_t *state, const uint8_t *in, size_t size) {
+    const uint8_t *end = in + size;
+    size_t i = 0;
+    while (in < end) {
+        i += in[0] | in[1] << 8;
+        size_t literals = in[2] | in[3] << 8;
+        in += 4;
+        for (size_t j = 0; j < literals; ++j) {
+            state[i + j] ^= in[j];
+        }
+        in += literals;
+        i += literals;
+    }
+}
+
+Rewind *createRewind(int capacity, int keyframeInterval) {
+    Rewind *rewind = calloc(1, sizeof(Rewind));
+    if (rewind == NULL) {
+        return NULL;
+    }
+    rewind->entries = calloc(capacity, sizeof(RewindEntry));
+    // a literal token per 5 bytes at worst, plus one for each split run
+    rewind->encoded = malloc(sizeof(Chip8State) + sizeof(Chip8State) / (MIN_ZERO_RUN + 1) * 4
+                             + sizeof(Chip8State) / MAX_RUN * 4 + 8);
+    if (rewind->entries == NULL || rewind->encoded == NULL) {
+        destroyRewind(rewind);
+        return NULL;
+    }
+    rewind->capacity = capacity;
+    rewind->keyframeInterval = keyframeInterval;
+    return rewind;
+}
+
+void destroyRewind(Rewind *rewind) {
+    if (rewind == NULL) {
+        return;
+    }
+    clearRewind(rewind);
+    free(rewind->entries);
+    free(rewind->encoded);
+    free(rewind);
+}
+
+static RewindEntry *entryAt(Rewind *rewind, int index) {
+    return &rewind->entries[(rewind->first + index) % rewind->capacity];
+}
+
+static void dropOldest(Rewind *rewind) {
+    RewindEntry *entry = entryAt(rewind, 0);
+    rewind->bytes -= entry->size;
+    free(entry->data);
+    entry->data = NULL;
+    rewind->first = (rewind->first + 1) % rewind->capacity;
+    rewind->count--;
+}
+
+void pushRewind(Rewind *rewind, const Chip8 *chip8) {
+    Chip8State *state = &rewind->scratch;
+    saveChip8State(chip8, state);
+    if (!rewind->hasBase) {
+        rewind->base = *state;
+        rewind->hasBase = 1;
+    }
+
+    if (rewind->count == rewind->capacity) {
+        // deltas are useless without their keyframe, so drop whole groups
+        do {
+            dropOldest(rewind);
+        } while (rewind->count > 0 && !entryAt(rewind, 0)->isKeyframe);
+        if (rewind->count == 0) {
+            rewind->sinceKeyframe = 0;
+        }
+    }
+
+    int isKeyframe = rewind->sinceKeyframe == 0 || rewind->sinceKeyframe == rewind->keyframeInterval;
+    const Chip8State *reference = isKeyframe ? &rewind->base : &rewind->keyframe;
+    size_t size = encodeXor((const uint8_t *)state, (const uint8_t *)reference, sizeof(Chip8State),
+                            rewind->encoded);
+
+    RewindEntry *entry = entryAt(rewind, rewind->count);
+    entry->data = malloc(size);
+    if (entry->data == NULL) {
+        return;
+    }
+    memcpy(entry->data, rewind->encoded, size);
+    entry->size = size;
+    entry->isKeyframe = isKeyframe;
+    rewind->count++;
+    rewind->bytes += size;
+
+    if (isKeyframe) {
+        rewind->keyframe = *state;
+        rewind->sinceKeyframe = 1;
+    } else {
+        rewind->sinceKeyframe++;
+    }
+}
+
+int rewindChip8(Rewind *rewind, Chip8 *chip8) {
+    if (rewind->count == 0) {
+        return 0;
+    }
+    RewindEntry *entry = entryAt(rewind, rewind->count - 1);
+    Chip8State *state = &rewind->scratch;
+    *state = entry->isKeyframe ? rewind->base : rewind->keyframe;
+    decodeXor((uint8_t *)state, entry->data, entry->size);
+    loadChip8State(chip8, state);
+
+    rewind->bytes -= entry->size;
+    free(entry->data);
+    entry->data = NULL;
+    rewind->count--;
+    rewind->sinceKeyframe--;
+
+    if (entry->isKeyframe && rewind->count > 0) {
+        // step back to the previous keyframe so older deltas can be decoded
+        int index = rewind->count - 1;
+        while (!entryAt(rewind, index)->isKeyframe) {
+            index--;
+        }
+        RewindEntry *keyframe = entryAt(rewind, index);
+        rewind->keyframe = rewind->base;
+        decodeXor((uint8_t *)&rewind->keyframe, keyframe->data, keyframe->size);
+        rewind->sinceKeyframe = rewind->count - index;
+    }
+    return 1;
+}
+
+void clearRewind(Rewind *rewind) {
+    while (rewind->count > 0) {
+        dropOldest(rewind);
+    }
+    rewind->first = 0;
+    rewind->sinceKeyframe = 0;
+    rewind->hasBase = 0;
+}
+
+int rewindLength(const Rewind *rewind) {
+    return rewind->count;
+}
+
+size_t rewindBytes(const Rewind *rewind) {
+    return rewind->bytes;
+}
@@ -0,0 +1,40 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stddef.h>
+
+#include "Chip8.h"
+
+// In-memory history of the machine, one snapshot per frame, for stepping backwards.
+//
+// Snapshots are Chip8States (see SaveState.h) stored compressed in a ring:
+//   - the first snapshot ever pushed is kept whole as a base,
+//   - every keyframeInterval-th snapshot is a keyframe, stored as its XOR against the base,
+//   - the rest are stored as their XOR against the newest keyframe before them.
+// Between nearby states almost every byte XORs to zero, and the zero runs are
+// run-length encoded, so a frame usually costs tens of bytes. Restoring any snapshot
+// is two XOR passes over one state, never a chain of deltas.
+
+typedef struct Rewind Rewind;
+
+// Keeps the newest capacity snapshots. Returns NULL if out of memory.
+Rewind *createRewind(int capacity, int keyframeInterval);
+
+void destroyRewind(Rewind *rewind);
+
+// Records the current state. Call once per frame. Once full, the oldest keyframe and
+// the snapshots that depend on it are dropped.
+void pushRewind(Rewind *rewind, const Chip8 *chip8);
+
+// Restores the newest snapshot and removes it from the history.
+// Returns 0 if the history is empty.
+int rewindChip8(Rewind *rewind, Chip8 *chip8);
+
+// Forgets everything (e.g. after loading a save state or a different ROM)
+void clearRewind(Rewind *rewind);
+
+// Number of snapshots held, and the bytes used to store them
+int rewindLength(const Rewind *rewind);
+size_t rewindBytes(const Rewind *rewind);
+
+#endif // REWIND_H
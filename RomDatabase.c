@@ -0,0 +1,64 @@
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "RomDatabase.h"
+#include "Tuner.h"
+
+uint64_t hashRomFile(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    uint64_t hash = 0xCBF29CE484222325ull;
+    int c;
+    while ((c = fgetc(file)) != EOF) {
+        hash ^= (uint8_t)c;
+        hash *= 0x100000001B3ull;
+    }
+    fclose(file);
+    return hash;
+}
+
+int lookupRomRate(const char *path, uint64_t romHash) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    char line[512];
+    int lineNumber = 0;
+    int rate = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        char *start = line;
+        while (isspace((unsigned char)*start)) {
+            start++;
+        }
+        if (*start == '\0') {
+            continue;
+        }
+
+        // the hash, whitespace, then the rate. The rest of the line is free text
+        uint64_t hash;
+        int lineRate;
+        if (sscanf(start, "%" SCNx64 " %d", &hash, &lineRate) != 2) {
+            fprintf(stderr, "%s:%d: expected a ROM hash and instructions per frame\n", path, lineNumber);
+            continue;
+        }
+        if (lineRate < 1 || lineRate > TUNER_MAX_RATE) {
+            fprintf(stderr, "%s:%d: instructions per frame must be 1 to %d\n", path, lineNumber, TUNER_MAX_RATE);
+            continue;
+        }
+        // a later line for the same ROM wins, so an appended entry overrides an old one
+        if (hash == romHash) {
+            rate = lineRate;
+        }
+    }
+    fclose(file);
+    return rate;
+}
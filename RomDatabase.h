@@ -0,0 +1,20 @@
+#ifndef ROMDATABASE_H
+#define ROMDATABASE_H
+
+#include <stdint.h>
+
+// Per-ROM settings, read from a text file at startup. Each line is a ROM's hash (see
+// hashRomFile) in hex and the instructions per frame to run it at, e.g.
+//   9c4a3e2f1d5b6a78 12 Pong (1 player).ch8
+// Anything after the rate is ignored, so the ROM's name can follow, and # starts a comment.
+// ROMs are found by content, so a renamed or moved file keeps its settings.
+
+// FNV-1a hash of a ROM file. Returns 0 if it can't be read
+uint64_t hashRomFile(const char *path);
+
+// Looks romHash up in the database at path. Returns its instructions per frame, 0 if it
+// isn't listed, or -1 if the file can't be read. Bad lines, including rates outside 1 to
+// TUNER_MAX_RATE, are reported and skipped.
+int lookupRomRate(const char *path, uint64_t romHash);
+
+#endif // ROMDATABASE_H
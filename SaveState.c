@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "SaveState.h"
+#include "Decoder.h"
+
+// the rewind buffer relies on there being no padding bytes with undefined contents
+_Static_assert(sizeof(Chip8State) == MEMORY_SIZE + DISPLAY_PLANES * DISPLAY_HEIGHT * 16 + 16 + STACK_SIZE * 2 + 6 +
+               GENERAL_REGISTER_COUNT + 8 + USER_FLAGS + 16 + 4 + 14, "Chip8State has padding");
+
+#define PAGE_SIZE 64
+
+void saveChip8State(const Chip8 *chip8, Chip8State *state) {
+    memcpy(state->memory, chip8->memory, MEMORY_SIZE);
+    memcpy(state->planes, chip8->display.planes, sizeof(state->planes));
+    state->rngState = chip8->rngState;
+    state->writtenPages = chip8->writtenPages;
+    memcpy(state->stack, chip8->stack, sizeof(state->stack));
+    state->I = chip8->I;
+    state->pc = chip8->pc;
+    state->keys = chip8->keys;
+    memcpy(state->V, chip8->V, GENERAL_REGISTER_COUNT);
+    state->sp = chip8->sp;
+    state->delay_timer = chip8->delay_timer;
+    state->sound_timer = chip8->sound_timer;
+    state->waitingForKey = chip8->waitingForKey;
+    state->keyRegister = chip8->keyRegister;
+    state->hires = chip8->display.hires;
+    state->planeMask = chip8->display.planeMask;
+    state->pitch = chip8->pitch;
+    memcpy(state->userFlags, chip8->userFlags, USER_FLAGS);
+    memcpy(state->audioPattern, chip8->audioPattern, sizeof(state->audioPattern));
+    state->frameCycles = chip8->frameCycles;
+    state->frameInstructions = chip8->frameInstructions;
+    memset(state->reserved, 0, sizeof(state->reserved));
+}
+
+void loadChip8State(Chip8 *chip8, const Chip8State *state) {
+    // usually only a few pages differ (rewinding one frame, say), and only those
+    // need decoding again and their compiled blocks thrown away
+    for (int page = 0; page < MEMORY_SIZE; page += PAGE_SIZE) {
+        if (memcmp(chip8->memory + page, state->memory + page, PAGE_SIZE) != 0) {
+            memcpy(chip8->memory + page, state->memory + page, PAGE_SIZE);
+            invalidateDecoded(chip8, page, PAGE_SIZE);
+        }
+    }
+    memcpy(chip8->display.planes, state->planes, sizeof(state->planes));
+    chip8->display.hires = state->hires;
+    chip8->display.planeMask = state->planeMask;
+    markDisplayDirty(&chip8->display);
+    chip8->rngState = state->rngState;
+    chip8->writtenPages = state->writtenPages;
+    memcpy(chip8->stack, state->stack, sizeof(state->stack));
+    chip8->I = state->I;
+    chip8->pc = state->pc;
+    chip8->keys = state->keys;
+    memcpy(chip8->V, state->V, GENERAL_REGISTER_COUNT);
+    chip8->sp = state->sp;
+    chip8->delay_timer = state->delay_timer;
+    chip8->sound_timer = state->sound_timer;
+    chip8->waitingForKey = state->waitingForKey;
+    chip8->keyRegister = state->keyRegister;
+    chip8->pitch = state->pitch;
+    memcpy(chip8->userFlags, state->userFlags, USER_FLAGS);
+    memcpy(chip8->audioPattern, state->audioPattern, sizeof(state->audioPattern));
+    chip8->frameCycles = state->frameCycles;
+    chip8->frameInstructions = state->frameInstructions;
+}
+
+// File layout: "CH8S", u32 version, then the fields of Chip8State in declaration order,
+// multi-byte values little-endian. Display rows are 16 bytes, low half first.
+static const char magic[4] = {'C', 'H', '8', 'S'};
+
+static void putValue(uint8_t **out, uint64_t value, int size) {
+    for (int i = 0; i < size; ++i) {
+        *(*out)++ = value >> (8 * i);
+    }
+}
+
+static uint64_t getValue(const uint8_t **in, int size) {
+    uint64_t value = 0;
+    for (int i = 0; i < size; ++i) {
+        value |= (uint64_t)*(*in)++ << (8 * i);
+    }
+    return value;
+}
+
+static void putBytes(uint8_t **out, const void *data, size_t size) {
+    memcpy(*out, data, size);
+    *out += size;
+}
+
+static void getBytes(const uint8_t **in, void *data, size_t size) {
+    memcpy(data, *in, size);
+    *in += size;
+}
+
+int writeChip8State(const Chip8State *state, const char *path) {
+    uint8_t buffer[sizeof(magic) + 4 + sizeof(Chip8State)];
+    uint8_t *out = buffer;
+    putBytes(&out, magic, sizeof(magic));
+    putValue(&out, SAVE_STATE_VERSION, 4);
+    putBytes(&out, state->memory, MEMORY_SIZE);
+    for (int plane = 0; plane < DISPLAY_PLANES; ++plane) {
+        for (int y = 0; y < DISPLAY_HEIGHT; ++y) {
+            putValue(&out, (uint64_t)state->planes[plane][y], 8);
+            putValue(&out, (uint64_t)(state->planes[plane][y] >> 64), 8);
+        }
+    }
+    putValue(&out, state->rngState, 8);
+    putValue(&out, state->writtenPages, 8);
+    for (int i = 0; i < STACK_SIZE; ++i) {
+        putValue(&out, state->stack[i], 2);
+    }
+    putValue(&out, state->I, 2);
+    putValue(&out, state->pc, 2);
+    putValue(&out, state->keys, 2);
+    putBytes(&out, state->V, GENERAL_REGISTER_COUNT);
+    // sp only matters modulo STACK_SIZE (a 00EE on an empty stack wraps it to 255), so files
+    // always hold it in range and readChip8State can refuse anything else
+    putValue(&out, state->sp % STACK_SIZE, 1);
+    putValue(&out, state->delay_timer, 1);
+    putValue(&out, state->sound_timer, 1);
+    putValue(&out, state->waitingForKey, 1);
+    putValue(&out, state->keyRegister, 1);
+    putValue(&out, state->hires, 1);
+    putValue(&out, state->planeMask, 1);
+    putValue(&out, state->pitch, 1);
+    putBytes(&out, state->userFlags, USER_FLAGS);
+    putBytes(&out, state->audioPattern, sizeof(state->audioPattern));
+    putValue(&out, state->frameCycles, 2);
+    putValue(&out, state->frameInstructions, 2);
+    putBytes(&out, state->reserved, sizeof(state->reserved));
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return -1;
+    }
+    size_t size = out - buffer;
+    int ok = fwrite(buffer, 1, size, file) == size;
+    ok &= fclose(file) == 0;
+    return ok ? 0 : -1;
+}
+
+int readChip8State(Chip8State *state, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+    uint8_t buffer[sizeof(magic) + 4 + sizeof(Chip8State)];
+    size_t size = fread(buffer, 1, sizeof(buffer), file);
+    fclose(file);
+
+    const uint8_t *in = buffer;
+    if (size < sizeof(magic) + 4 || memcmp(in, magic, sizeof(magic)) != 0) {
+        return -1;
+    }
+    in += sizeof(magic);
+    if (getValue(&in, 4) != SAVE_STATE_VERSION) {
+        return -1;
+    }
+    // everything after the header is fixed size in this version
+    if (size != sizeof(magic) + 4 + sizeof(Chip8State)) {
+        return -1;
+    }
+    getBytes(&in, state->memory, MEMORY_SIZE);
+    for (int plane = 0; plane < DISPLAY_PLANES; ++plane) {
+        for (int y = 0; y < DISPLAY_HEIGHT; ++y) {
+            DisplayRow low = getValue(&in, 8);
+            state->planes[plane][y] = (DisplayRow)getValue(&in, 8) << 64 | low;
+        }
+    }
+    state->rngState = getValue(&in, 8);
+    state->writtenPages = getValue(&in, 8);
+    for (int i = 0; i < STACK_SIZE; ++i) {
+        state->stack[i] = getValue(&in, 2);
+    }
+    state->I = getValue(&in, 2);
+    state->pc = getValue(&in, 2);
+    state->keys = getValue(&in, 2);
+    getBytes(&in, state->V, GENERAL_REGISTER_COUNT);
+    state->sp = getValue(&in, 1);
+    state->delay_timer = getValue(&in, 1);
+    state->sound_timer = getValue(&in, 1);
+    state->waitingForKey = getValue(&in, 1);
+    state->keyRegister = getValue(&in, 1);
+    state->hires = getValue(&in, 1);
+    state->planeMask = getValue(&in, 1);
+    state->pitch = getValue(&in, 1);
+    getBytes(&in, state->userFlags, USER_FLAGS);
+    getBytes(&in, state->audioPattern, sizeof(state->audioPattern));
+    state->frameCycles = getValue(&in, 2);
+    state->frameInstructions = getValue(&in, 2);
+    getBytes(&in, state->reserved, sizeof(state->reserved));
+
+    // values the rest of the code assumes are in range. A damaged or hand-edited file is refused
+    if (state->sp > STACK_SIZE || state->keyRegister >= GENERAL_REGISTER_COUNT || state->hires > 1
+            || state->planeMask >= 1 << DISPLAY_PLANES) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Chip8.h"
+
+// Bumped whenever the file layout changes. Files from other versions are refused.
+#define SAVE_STATE_VERSION 5
+
+// Everything in a Chip8 that affects what it does next. The decode cache and the
+// recompiler aren't included; they are rebuilt from memory on load. Neither is the quirk
+// profile, which is part of the configuration like the recompiler.
+// Kept free of padding so a state can be compared and XORed as plain bytes (see Rewind.h).
+typedef struct {
+    uint8_t memory[MEMORY_SIZE];
+    DisplayRow planes[DISPLAY_PLANES][DISPLAY_HEIGHT];
+    uint64_t rngState;
+    uint64_t writtenPages;
+    uint16_t stack[STACK_SIZE];
+    uint16_t I;
+    uint16_t pc;
+    uint16_t keys;
+    uint8_t V[GENERAL_REGISTER_COUNT];
+    uint8_t sp;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    uint8_t waitingForKey;
+    uint8_t keyRegister;
+    uint8_t hires;
+    uint8_t planeMask;
+    uint8_t pitch;
+    uint8_t userFlags[USER_FLAGS];
+    uint8_t audioPattern[16];
+    uint16_t frameCycles;
+    uint16_t frameInstructions;
+    // always zero. Rounds the size up to DisplayRow's alignment, so there's no padding
+    uint8_t reserved[14];
+} Chip8State;
+
+// Copies the machine into state
+void saveChip8State(const Chip8 *chip8, Chip8State *state);
+
+// Puts the machine back the way it was when state was saved. Only the 64-byte pages of
+// memory that differ are written and decoded again, so this takes microseconds.
+// The whole screen is marked dirty.
+void loadChip8State(Chip8 *chip8, const Chip8State *state);
+
+// Writes state to a file in the versioned little-endian format. Returns 0 on success, -1 on failure.
+int writeChip8State(const Chip8State *state, const char *path);
+
+// Reads a file written by writeChip8State. Returns 0 on success, -1 if the file can't be read,
+// is truncated, is from a different version or holds out of range values (sp past STACK_SIZE,
+// keyRegister past VF, hires other than 0 or 1, planeMask selecting planes that don't exist).
+int readChip8State(Chip8State *state, const char *path);
+
+#endif // SAVESTATE_H
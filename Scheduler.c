@@ -0,0 +1,82 @@
+#include "Scheduler.h"
+
+// If we fall this many frames behind (debugger, window drag, slow present)
+// the schedule is reset instead of running the missed frames back to back.
+#define MAX_FRAMES_BEHIND 5
+
+void initScheduler(Scheduler *scheduler, ScheduleMode mode, int hz) {
+    scheduler->mode = mode;
+    scheduler->frequency = SDL_GetPerformanceFrequency();
+    scheduler->ticksPerFrame = scheduler->frequency / hz;
+    scheduler->startTime = SDL_GetPerformanceCounter();
+    scheduler->nextFrame = scheduler->startTime;
+    scheduler->pendingFrames = 0;
+    scheduler->frameCount = 0;
+}
+
+Uint32 timeUntilNextFrame(Scheduler *scheduler) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now >= scheduler->nextFrame) {
+        return 0;
+    }
+    return (Uint32)((scheduler->nextFrame - now) * 1000 / scheduler->frequency);
+}
+
+// Sleeps until the counter reaches target. SDL_Delay only has millisecond
+// resolution and may oversleep, so sleep until about 1ms before the target and
+// yield for the remainder.
+static void sleepUntil(Scheduler *scheduler, Uint64 target) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    while (now < target) {
+        Uint64 remainingMs = (target - now) * 1000 / scheduler->frequency;
+        if (remainingMs > 1) {
+            SDL_Delay((Uint32)(remainingMs - 1));
+        } else {
+            SDL_Delay(0);
+        }
+        now = SDL_GetPerformanceCounter();
+    }
+}
+
+int beginFrame(Scheduler *scheduler) {
+    switch (scheduler->mode) {
+        case SCHEDULE_REALTIME: {
+            sleepUntil(scheduler, scheduler->nextFrame);
+            // schedule from the ideal time rather than from now, so oversleeping
+            // one frame is made up on the next and the rate doesn't drift
+            scheduler->nextFrame += scheduler->ticksPerFrame;
+            Uint64 now = SDL_GetPerformanceCounter();
+            if (now > scheduler->nextFrame + MAX_FRAMES_BEHIND * scheduler->ticksPerFrame) {
+                scheduler->nextFrame = now + scheduler->ticksPerFrame;
+            }
+            break;
+        }
+        case SCHEDULE_TURBO:
+            break;
+        case SCHEDULE_FIXED_STEP:
+            if (scheduler->pendingFrames == 0) {
+                return 0;
+            }
+            scheduler->pendingFrames--;
+            break;
+    }
+    scheduler->frameCount++;
+    return 1;
+}
+
+void requestFrames(Scheduler *scheduler, uint64_t frames) {
+    scheduler->pendingFrames += frames;
+}
+
+int realFrameElapsed(Scheduler *scheduler) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now < scheduler->nextFrame) {
+        return 0;
+    }
+    scheduler->nextFrame = now + scheduler->ticksPerFrame;
+    return 1;
+}
+
+double elapsedSeconds(Scheduler *scheduler) {
+    return (double)(SDL_GetPerformanceCounter() - scheduler->startTime) / scheduler->frequency;
+}
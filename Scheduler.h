@@ -0,0 +1,52 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+// How emulated frames are paced against the host clock
+typedef enum {
+    // one frame every 1/60th of a second, sleeping in between
+    SCHEDULE_REALTIME,
+    // frames back to back with no sleeping. Timers tick once per emulated frame,
+    // so game speed scales with the host
+    SCHEDULE_TURBO,
+    // frames only run when the caller asks for them with requestFrames
+    SCHEDULE_FIXED_STEP
+} ScheduleMode;
+
+typedef struct {
+    ScheduleMode mode;
+    // performance counter ticks per second and per emulated frame
+    Uint64 frequency;
+    Uint64 ticksPerFrame;
+    // counter value the next realtime frame is due at
+    Uint64 nextFrame;
+    Uint64 startTime;
+    // frames the caller has asked for in fixed step mode
+    uint64_t pendingFrames;
+    // frames started so far
+    uint64_t frameCount;
+} Scheduler;
+
+void initScheduler(Scheduler *scheduler, ScheduleMode mode, int hz);
+
+// Waits until the next frame should run. Sleeps in realtime mode and returns immediately
+// in turbo mode. In fixed step mode it never waits and returns 0 if no frame was requested.
+// Returns 1 when a frame should run.
+int beginFrame(Scheduler *scheduler);
+
+// Queues frames for fixed step mode
+void requestFrames(Scheduler *scheduler, uint64_t frames);
+
+// Milliseconds until the next realtime frame is due (0 if it is already due)
+Uint32 timeUntilNextFrame(Scheduler *scheduler);
+
+// Returns 1 once per real 1/60th of a second. Used to limit presents in turbo mode.
+int realFrameElapsed(Scheduler *scheduler);
+
+// Seconds of wall clock time since initScheduler
+double elapsedSeconds(Scheduler *scheduler);
+
+#endif // SCHEDULER_H
@@ -0,0 +1,109 @@
+#include <threads.h>
+
+#include "Timing.h"
+#include "Profile.h"
+
+// Every instruction goes through the interpreter's fetch and decode loop first
+#define FETCH_CYCLES 40
+// Set in a cost table entry for Dxyn, which waits for the display interrupt before drawing
+#define WAITS_FOR_INTERRUPT 0x8000
+
+// The execute cycles of each opcode, approximated from the VIP interpreter's routines.
+// Where the real cost depends on the data (skips taken, Fx33's digits, how a sprite lines
+// up with display bytes) this is the common case.
+static int executeCycles(uint16_t opcode) {
+    uint8_t x = (opcode & 0x0F00) >> 8;
+    uint8_t n = opcode & 0x000F;
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            if (opcode == 0x00E0) {
+                // clears the 256 bytes of display memory
+                return 3078;
+            }
+            return opcode == 0x00EE ? 10 : 0;
+        case 0x1000: return 12;
+        case 0x2000: return 26;
+        case 0x3000: return 10;
+        case 0x4000: return 10;
+        case 0x5000: return 14;
+        case 0x6000: return 6;
+        case 0x7000: return 10;
+        // 8xy0 is a plain copy. The others build a one-instruction 1802 routine and call it
+        case 0x8000: return n == 0 ? 12 : 44;
+        case 0x9000: return 14;
+        case 0xA000: return 12;
+        case 0xB000: return 22;
+        case 0xC000: return 36;
+        // setup, then each sprite row is shifted into place and XORed over two display bytes
+        case 0xD000: return 34 + 46 * n;
+        case 0xE000: return 14;
+        case 0xF000:
+            switch (opcode & 0x00FF) {
+                case 0x0007: return 10;
+                case 0x000A: return 18;
+                case 0x0015: return 10;
+                case 0x0018: return 10;
+                case 0x001E: return 16;
+                case 0x0029: return 16;
+                // repeated subtraction of 100s and 10s
+                case 0x0033: return 152;
+                case 0x0055:
+                case 0x0065: return 14 + 14 * (x + 1);
+            }
+            return 0;
+    }
+    return 0;
+}
+
+int vipCycles(uint16_t opcode) {
+    return FETCH_CYCLES + executeCycles(opcode);
+}
+
+// Indexed by opcode. Built once, the first time anything runs with VIP timing
+static uint16_t cycleTable[0x10000];
+static once_flag cycleTableBuilt = ONCE_FLAG_INIT;
+
+static void buildCycleTable(void) {
+    for (int opcode = 0; opcode < 0x10000; ++opcode) {
+        cycleTable[opcode] = vipCycles(opcode);
+        if ((opcode & 0xF000) == 0xD000) {
+            cycleTable[opcode] |= WAITS_FOR_INTERRUPT;
+        }
+    }
+}
+
+int runChip8Cycles(Chip8 *chip8, int cycles) {
+    call_once(&cycleTableBuilt, buildCycleTable);
+    int end = chip8->frameCycles + cycles;
+    if (end > VIP_FRAME_BUDGET) {
+        end = VIP_FRAME_BUDGET;
+    }
+
+    int executed = 0;
+    while (chip8->frameCycles < end && !chip8->waitingForKey) {
+        uint16_t pc = chip8->pc;
+        // the cost comes from memory rather than the decoded entry, which may be stale
+        unsigned cost = cycleTable[chip8->memory[pc] << 8 | chip8->memory[(uint16_t)(pc + 1)]];
+        if ((cost & WAITS_FOR_INTERRUPT) && chip8->frameInstructions > 0) {
+            // idle until the interrupt. The draw runs first thing next frame
+            chip8->frameCycles = VIP_FRAME_BUDGET;
+            break;
+        }
+        const Instruction *ins = &chip8->decoded[pc];
+        chip8->opcode = ins->opcode;
+        PROFILE_START();
+        ins->handler(chip8, ins);
+        PROFILE_END(pc, chip8->opcode, chip8->quirks);
+        chip8->frameCycles += cost & ~WAITS_FOR_INTERRUPT;
+        chip8->frameInstructions++;
+        executed++;
+    }
+    return executed;
+}
+
+void endVipFrame(Chip8 *chip8) {
+    // keep whatever the last instruction ran over by. A frame cut short by Fx0A starts afresh
+    chip8->frameCycles = chip8->frameCycles > VIP_FRAME_BUDGET ? chip8->frameCycles - VIP_FRAME_BUDGET : 0;
+    chip8->frameInstructions = 0;
+    updateTimers(chip8);
+}
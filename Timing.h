@@ -0,0 +1,39 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+
+#include "Chip8.h"
+
+// COSMAC VIP timing. Instead of a fixed number of instructions per frame, each instruction
+// is charged the machine cycles the VIP's interpreter spent on it, and a frame is as many
+// cycles as the VIP had between two display interrupts.
+//
+// The VIP's CDP1802 runs at 1.76064MHz with 8 clocks to a machine cycle: 3668 cycles per
+// 60hz frame. The CDP1861's display DMA takes 1024 of them (8 bytes on each of 128 lines)
+// and the interrupt routine that sets it up and ticks the timers about 100 more.
+#define VIP_CYCLES_PER_FRAME 3668
+#define VIP_INTERRUPT_CYCLES 1124
+// what is left for CHIP-8 instructions each frame
+#define VIP_FRAME_BUDGET (VIP_CYCLES_PER_FRAME - VIP_INTERRUPT_CYCLES)
+
+// Executes instructions until they have used cycles more machine cycles or the frame's
+// budget is spent. chip8->frameCycles carries the position in the frame between calls, so a
+// frame can be run in chunks with input sampled in between. An instruction that runs past the
+// end of the frame is finished and the excess is taken from the next one.
+// Dxyn waits for the next display interrupt, as the VIP's did: unless it is the first thing
+// in the frame, the rest of the frame is spent waiting and the sprite is drawn at the start of
+// the next, so at most one sprite is drawn per frame.
+// Always interprets; the recompiler's blocks don't stop at cycle boundaries.
+// Returns the number of instructions executed. Stops early if the CPU is waiting for a key.
+int runChip8Cycles(Chip8 *chip8, int cycles);
+
+// The display interrupt at the end of a frame under VIP timing. Call in place of
+// updateTimers once runChip8Cycles has used the frame's budget.
+void endVipFrame(Chip8 *chip8);
+
+// Machine cycles the VIP's interpreter takes to fetch and execute opcode, not counting
+// any wait for the display interrupt
+int vipCycles(uint16_t opcode);
+
+#endif // TIMING_H
@@ -0,0 +1,67 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Display.h"
+
+// Hands finished frames from the emulator thread to the window thread without locks
+// and without either side ever waiting for the other.
+//
+// There are three copies of the framebuffer. The writer fills its back copy and
+// swaps it with the middle one; the reader swaps its front copy with the middle one when
+// the middle holds a frame it hasn't seen. The swaps are single atomic exchanges of an
+// index, so the reader always gets the newest complete frame and frames it is too slow
+// for are simply replaced.
+// What the window needs of a Display to draw it
+typedef struct {
+    DisplayRow planes[DISPLAY_PLANES][DISPLAY_HEIGHT];
+    uint8_t hires;
+} DisplayFrame;
+
+typedef struct {
+    DisplayFrame frames[3];
+    // index of the middle copy, plus TRIPLE_BUFFER_FRESH when the writer has published
+    // into it since the reader last took it
+    _Alignas(64) atomic_int middle;
+    // owned by the writer
+    _Alignas(64) int back;
+    // owned by the reader
+    _Alignas(64) int front;
+} TripleBuffer;
+
+#define TRIPLE_BUFFER_FRESH 4
+
+static inline void initTripleBuffer(TripleBuffer *buffer) {
+    memset(buffer->frames, 0, sizeof(buffer->frames));
+    buffer->back = 0;
+    atomic_init(&buffer->middle, 1);
+    buffer->front = 2;
+}
+
+// Writer side. The frame to fill in next
+static inline DisplayFrame *tripleBufferBack(TripleBuffer *buffer) {
+    return &buffer->frames[buffer->back];
+}
+
+// Writer side. Makes the back frame the newest one
+static inline void publishTripleBuffer(TripleBuffer *buffer) {
+    int old = atomic_exchange_explicit(&buffer->middle, buffer->back | TRIPLE_BUFFER_FRESH,
+                                       memory_order_acq_rel);
+    buffer->back = old & 3;
+}
+
+// Reader side. Returns the newest frame, or NULL if nothing was published since
+// the last call. The frame stays valid until the next call.
+static inline const DisplayFrame *consumeTripleBuffer(TripleBuffer *buffer) {
+    if (!(atomic_load_explicit(&buffer->middle, memory_order_relaxed) & TRIPLE_BUFFER_FRESH)) {
+        return NULL;
+    }
+    int old = atomic_exchange_explicit(&buffer->middle, buffer->front, memory_order_acq_rel);
+    buffer->front = old & 3;
+    return &buffer->frames[buffer->front];
+}
+
+#endif // TRIPLEBUFFER_H
@@ -0,0 +1,81 @@
+#include <string.h>
+
+#include "Tuner.h"
+
+static int clampRate(int rate) {
+    if (rate < 1) {
+        return 1;
+    }
+    return rate > TUNER_MAX_RATE ? TUNER_MAX_RATE : rate;
+}
+
+void initTuner(Tuner *tuner, int minimum, int maximum, int start) {
+    memset(tuner, 0, sizeof(*tuner));
+    tuner->minimum = clampRate(minimum);
+    tuner->maximum = clampRate(maximum);
+    if (tuner->maximum < tuner->minimum) {
+        tuner->maximum = tuner->minimum;
+    }
+    if (start < tuner->minimum) {
+        start = tuner->minimum;
+    } else if (start > tuner->maximum) {
+        start = tuner->maximum;
+    }
+    tuner->instructionsPerFrame = start;
+}
+
+void beginTunedFrame(Tuner *tuner, const Chip8 *chip8) {
+    tuner->idleAtStart = chip8->idleInstructions;
+    tuner->spritesAtStart = chip8->display.spritesDrawn;
+}
+
+// At the end of a window. Moves the budget by an eighth (at least one) if the ROM
+// waited too much or too little, then starts the next window
+static void adjust(Tuner *tuner) {
+    int rate = tuner->instructionsPerFrame;
+    int step = rate / 8 > 1 ? rate / 8 : 1;
+    // compared in sixteenths of the instructions executed
+    uint64_t waited = tuner->waited * 16;
+    if (waited > tuner->executed * TUNER_HIGH_WAIT) {
+        rate -= step;
+    } else if (waited < tuner->executed * TUNER_LOW_WAIT && tuner->sprites > 0) {
+        rate += step;
+    }
+    if (rate < tuner->minimum) {
+        rate = tuner->minimum;
+    } else if (rate > tuner->maximum) {
+        rate = tuner->maximum;
+    }
+    tuner->instructionsPerFrame = rate;
+
+    tuner->frames = 0;
+    tuner->executed = 0;
+    tuner->waited = 0;
+    tuner->sprites = 0;
+}
+
+int endTunedFrame(Tuner *tuner, const Chip8 *chip8, int executed) {
+    if (chip8->waitingForKey) {
+        // the player sets the pace until a key comes in
+        return tuner->instructionsPerFrame;
+    }
+    tuner->framesAt[tuner->instructionsPerFrame]++;
+    tuner->frames++;
+    tuner->executed += executed;
+    tuner->waited += chip8->idleInstructions - tuner->idleAtStart;
+    tuner->sprites += chip8->display.spritesDrawn - tuner->spritesAtStart;
+    if (tuner->frames == TUNER_WINDOW) {
+        adjust(tuner);
+    }
+    return tuner->instructionsPerFrame;
+}
+
+int tunedRate(const Tuner *tuner) {
+    int best = tuner->instructionsPerFrame;
+    for (int rate = tuner->minimum; rate <= tuner->maximum; ++rate) {
+        if (tuner->framesAt[rate] > tuner->framesAt[best]) {
+            best = rate;
+        }
+    }
+    return best;
+}
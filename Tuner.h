@@ -0,0 +1,69 @@
+#ifndef TUNER_H
+#define TUNER_H
+
+#include <stdint.h>
+
+#include "Chip8.h"
+
+// Picks the instructions per frame for a ROM while it runs.
+//
+// Most games pace themselves on the delay timer: they do a frame's work, then spin in a
+// loop polling Fx07 until the next tick. Given more instructions than that work needs, the
+// rest of the frame goes on the wait loop; given fewer, the game runs slow. So the tuner
+// watches the share of each frame spent in wait loops (the instructions runChip8 counted
+// rather than ran) and keeps it between TUNER_LOW_WAIT and TUNER_HIGH_WAIT, moving the
+// budget by an eighth at a time once per TUNER_WINDOW frames:
+//   - more than half the frame waiting: the budget shrinks, the game gets nothing from it
+//   - almost none, while sprites are being drawn: the game is starved and the budget grows
+//   - almost none and nothing drawn (a title screen, a long calculation): left alone, since
+//     a game that never waits would otherwise be pushed to the maximum
+// Frames halted on Fx0A say nothing about the game's pace and are left out.
+// The measurements are instruction counts, not host time, so a given run tunes the same
+// way on any machine.
+
+// frames measured before each adjustment (a quarter of a second)
+#define TUNER_WINDOW 15
+// the share of a frame spent waiting that the tuner aims for, in sixteenths
+#define TUNER_LOW_WAIT 2
+#define TUNER_HIGH_WAIT 8
+// default bounds, and the largest budget that can be asked for
+#define TUNER_DEFAULT_MIN 4
+#define TUNER_DEFAULT_MAX 40
+#define TUNER_MAX_RATE 1000
+
+typedef struct {
+    int minimum;
+    int maximum;
+    // the budget for the next frame
+    int instructionsPerFrame;
+
+    // totals for the window being measured
+    int frames;
+    uint64_t executed;
+    uint64_t waited;
+    uint32_t sprites;
+    // the core's counters when the current frame started
+    uint64_t idleAtStart;
+    uint32_t spritesAtStart;
+
+    // frames run at each budget, for the report
+    uint32_t framesAt[TUNER_MAX_RATE + 1];
+} Tuner;
+
+// Tunes between minimum and maximum instructions per frame, starting from start.
+// The bounds are clamped to 1 to TUNER_MAX_RATE.
+void initTuner(Tuner *tuner, int minimum, int maximum, int start);
+
+// Call before running a frame. Anything chip8 does between endTunedFrame and the next call
+// (run-ahead, say) isn't counted
+void beginTunedFrame(Tuner *tuner, const Chip8 *chip8);
+
+// Call once the frame has run, with the instructions runChip8 returned for it.
+// Returns the budget for the next frame.
+int endTunedFrame(Tuner *tuner, const Chip8 *chip8, int executed);
+
+// The budget the tuner ran the most frames at: the rate to pin for the ROM.
+// The starting budget if no frames were measured.
+int tunedRate(const Tuner *tuner);
+
+#endif // TUNER_H